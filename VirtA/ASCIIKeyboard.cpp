@@ -35,7 +35,7 @@
 /**
  * Construction of an ASCIIKeyboard instance
  */
-ASCIIKeyboard::ASCIIKeyboard() : Peripheral() { }
+ASCIIKeyboard::ASCIIKeyboard() : Peripheral(), head(0), tail(0), idle(true), PDR(0) { }
 
 /**
  * Destruction of an ASCIIKeyboard instance
@@ -45,9 +45,22 @@ ASCIIKeyboard::~ASCIIKeyboard() {
 }
 
 /**
- * Reads a character from the data register
+ * Reads the next typed character into the data register
+ * Strobes again if another is waiting, otherwise leaves that to the next key press,
+ * so each character is signalled exactly once and only after it can be read
  */
 uint8_t ASCIIKeyboard::read() {
+    size_t next = head.load(std::memory_order_relaxed);
+    
+    if (next != tail.load(std::memory_order_acquire)) {
+        PDR = queue[next & (QUEUE_SIZE - 1)];
+        head.store(++next, std::memory_order_release);
+    }
+    
+    idle.store(true);
+    if (next != tail.load() && idle.exchange(false))
+        raise1();
+    
     return PDR;
 }
 
@@ -56,13 +69,14 @@ uint8_t ASCIIKeyboard::read() {
  * Does nothing
  */
 void ASCIIKeyboard::write(uint8_t value) {
-    
+
 }
 
 /**
  * Simulates a key press
+ * Returns false if too many characters are waiting for the CPU and the key press is dropped
  */
-void ASCIIKeyboard::keypress(uint8_t keycode) {
+bool ASCIIKeyboard::keypress(uint8_t keycode) {
     if (keycode == 0xa || keycode == 0xd)     // CR
         keycode = 0x8d;
     if (keycode == 0x7f)   // Backspace
@@ -71,17 +85,33 @@ void ASCIIKeyboard::keypress(uint8_t keycode) {
     if ((keycode & 0x60) == 0x60)   // Change lowercase to uppercase
         keycode &= 0xdf;
     
-    irq1 = true;            // Set interrupt line 1
-    PDR = keycode | 0x80;   // Set high bit
+    {
+        std::lock_guard<std::mutex> lock(producerMutex);
+        size_t next = tail.load(std::memory_order_relaxed);
+        if (next - head.load(std::memory_order_acquire) == QUEUE_SIZE)
+            return false;
+        
+        queue[next & (QUEUE_SIZE - 1)] = keycode | 0x80;    // Set high bit
+        tail.store(next + 1);
+    }
+    
+    // Strobe unless one is already outstanding
+    if (idle.exchange(false))
+        raise1();
+    
+    notify();   // Wake a CPU waiting for a key
+    
+    return true;
 }
 
 /**
  * Handles an array of key presses
- * For practical purposes, only the last key press is useful (PDR is overwritten by keypress method)
+ * Returns the number of characters queued, which falls short only if the queue fills up
  */
-void ASCIIKeyboard::textInput(const char *text) {
-    int i = 0;
-    while (text[i] != 0) {
-        keypress(text[i++]);
-    }
+size_t ASCIIKeyboard::textInput(const char *text) {
+    size_t i = 0;
+    while (text[i] != 0 && keypress(text[i]))
+        i++;
+    
+    return i;
 }
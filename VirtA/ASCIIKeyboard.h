@@ -30,13 +30,24 @@
 #ifndef ASCIIKeyboard_H
 #define ASCIIKeyboard_H
 
+#include <cstddef>
 #include <cstdint>
 
+#include <atomic>
+#include <mutex>
 #include <thread>
 
 #include "Peripheral.h"
 
-class ASCIIKeyboard: public Peripheral {
+class ASCIIKeyboard final : public Peripheral {
+    static const size_t QUEUE_SIZE = 16384;     // Characters waiting for the CPU, a power of two
+    
+    uint8_t queue[QUEUE_SIZE];      // Characters typed but not yet read
+    std::atomic<size_t> head;       // Next character to read, advanced by the CPU thread
+    std::atomic<size_t> tail;       // Next free slot, advanced by the typing threads
+    std::mutex producerMutex;       // Keeps typing threads apart, never taken by the CPU thread
+    std::atomic<bool> idle;         // No strobe is outstanding, so whoever finds a character waiting strobes
+    
     uint8_t PDR;
     
 public:
@@ -45,7 +56,7 @@ public:
     
     uint8_t read();
     void write(uint8_t value);
-    void keypress(uint8_t keycode);
-    void textInput(const char *text);
+    bool keypress(uint8_t keycode);
+    size_t textInput(const char *text);
 };
 #endif /* ASCIIKeyboard_H */
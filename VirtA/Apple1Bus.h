@@ -0,0 +1,123 @@
+//
+//  Apple1Bus.h
+//  Devices of an Apple I, with their types fixed at compile time
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Apple1Bus_H
+#define Apple1Bus_H
+
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "CPU.h"
+#include "MemoryMap.h"
+#include "Motorola6820.h"
+#include "StateArena.h"
+
+/**
+ * Keyboard, display and monitor ROM of an Apple I, wired to a memory map.
+ * The keyboard and terminal are named by type, so the 6820 between them and the
+ * processor calls straight into them.
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+class Apple1Bus {
+    std::shared_ptr<KeyboardDevice> keyboard;
+    std::shared_ptr<TerminalDevice> terminal;
+    Motorola6820<KeyboardDevice, TerminalDevice> pia;
+
+public:
+    static const uint_fast8_t RAM_SIZE = 8;         // Kilobytes, the second 4K at HIMEM
+    static const uint16_t HIMEM = 0xe000;
+    static const uint16_t PIA_ADDRESS = 0xd000;
+    static const uint16_t MONITOR_ADDRESS = 0xff00;
+    
+    Apple1Bus(MemoryMap &memoryMap, StateArena *arena, std::shared_ptr<KeyboardDevice> keyboard,
+              std::shared_ptr<TerminalDevice> terminal, std::string monitor);
+    
+    void connect(std::shared_ptr<CPU> cpu);
+    void disconnect();
+    
+    std::shared_ptr<KeyboardDevice> getKeyboard();
+    std::shared_ptr<TerminalDevice> getTerminal();
+};
+
+/**
+ * Connects the devices to the memory map and loads the monitor
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+Apple1Bus<KeyboardDevice, TerminalDevice>::Apple1Bus(MemoryMap &memoryMap, StateArena *arena, std::shared_ptr<KeyboardDevice> keyboard,
+                                         std::shared_ptr<TerminalDevice> terminal, std::string monitor)
+    : keyboard(keyboard), terminal(terminal), pia(PIA_ADDRESS, keyboard, terminal, arena) {
+    memoryMap.loadROM(MONITOR_ADDRESS, monitor);
+    memoryMap.registerInterface(&pia);
+}
+
+/**
+ * Lets the devices wake the processor and times the display by it
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+void Apple1Bus<KeyboardDevice, TerminalDevice>::connect(std::shared_ptr<CPU> cpu) {
+    // Key presses end the wait when the CPU is idle at the prompt, as does room in the display queue
+    std::weak_ptr<CPU> weakCPU = cpu;
+    std::function<void()> wake = [weakCPU]() {
+        if (std::shared_ptr<CPU> cpu = weakCPU.lock())
+            cpu->wake();
+    };
+    keyboard->setListener(wake);
+    terminal->setListener(wake);
+    
+    terminal->setCPU(cpu.get());
+}
+
+/**
+ * Stops timing the display by the processor, which must have stopped
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+void Apple1Bus<KeyboardDevice, TerminalDevice>::disconnect() {
+    terminal->setCPU(NULL);
+}
+
+/**
+ * Returns the keyboard
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+std::shared_ptr<KeyboardDevice> Apple1Bus<KeyboardDevice, TerminalDevice>::getKeyboard() {
+    return keyboard;
+}
+
+/**
+ * Returns the terminal
+ */
+template<typename KeyboardDevice, typename TerminalDevice>
+std::shared_ptr<TerminalDevice> Apple1Bus<KeyboardDevice, TerminalDevice>::getTerminal() {
+    return terminal;
+}
+
+#endif /* Apple1Bus_H */
@@ -50,11 +50,16 @@
 using namespace std;
 using namespace chrono;
 
+const size_t Apple1VideoTerminal::QUEUE_SIZE;
+const uint_fast32_t Apple1VideoTerminal::CYCLES_PER_CHARACTER;
+const uint_fast32_t Apple1VideoTerminal::OUTPUT_TIMEOUT;
+
 /**
  * Creates an instance of Apple1VideoTerminal
  * Takes a parameter that specifies a function callback to be notified of update requirements
  */
-Apple1VideoTerminal::Apple1VideoTerminal(void (*callback)()) : Terminal(), callback(callback) {
+Apple1VideoTerminal::Apple1VideoTerminal(void (*callback)())
+    : Terminal(), head(0), tail(0), stopping(false), cpu(NULL), readyCycle(0), busy(false), fastMode(false), callback(callback) {
     // Set up buffers and variable defaults
     displayReady = false;
     displayData = new uint8_t[PIXEL_WIDTH * PIXEL_HEIGHT * 3];
@@ -78,12 +83,19 @@ Apple1VideoTerminal::Apple1VideoTerminal(void (*callback)()) : Terminal(), callb
     
     // Display is ready for drawing
     displayReady = true;
+    
+    // Characters are drawn and sent to sockets away from the CPU thread
+    outputThread = thread(&Apple1VideoTerminal::process, this);
 }
 
 /**
- * Frees up the display buffers
+ * Stops the output thread and frees up the display buffers
  */
 Apple1VideoTerminal::~Apple1VideoTerminal() {
+    stopping = true;
+    outputCondition.notify_one();
+    outputThread.join();
+    
     if (displayData != NULL) {
         delete[] displayData;
         displayData = NULL;
@@ -95,13 +107,19 @@ Apple1VideoTerminal::~Apple1VideoTerminal() {
 }
 
 /**
- * Returns whether the display is ready for drawing
+ * Returns whether the display is ready for a character
+ * It takes one character per frame, counted in cycles of the CPU it is timed by,
+ * or any number in fast mode as long as there is room in the queue
  */
 uint8_t Apple1VideoTerminal::read() {
-    if (displayReady)
-        return 0x0;
-    else
+    if (!displayReady)
         return 0x80;
+    if (busy && !fastMode.load(memory_order_relaxed))
+        return 0x80;
+    if (tail.load(memory_order_relaxed) - head.load(memory_order_acquire) == QUEUE_SIZE)
+        return 0x80;
+    
+    return 0x0;
 }
 
 /**
@@ -230,26 +248,30 @@ void Apple1VideoTerminal::reshape(int width, int height) {
 }
 
 /**
- * Writes characters to any open sockets
+ * Adds a character to the output for any open sockets
  */
 void Apple1VideoTerminal::writeSockets(uint8_t value) {
-    std::vector<int>::iterator it = sockets.begin();
     static int counter = 0;
-    char buf[3];
-    ssize_t numbytes = 1;
     
-    buf[0] = value;
+    socketOutput.push_back(value);
     if (counter >= 40) {
-        buf[1] = '\n';
-        numbytes++;
+        socketOutput.push_back('\n');
         counter = 0;
     }
     counter++;
+}
+
+/**
+ * Sends the output gathered for the sockets to all of them at once
+ */
+void Apple1VideoTerminal::flushSockets() {
+    lock_guard<mutex> lock(socketsMutex);
+    std::vector<int>::iterator it = sockets.begin();
     
     // Iterate all sockets
     while (it != sockets.end()) {
         // Send the data
-        if (send(*it, buf, numbytes, 0) == -1) {
+        if (send(*it, socketOutput.data(), socketOutput.size(), 0) == -1) {
             // Close any sockets that are not working
             perror("send");
             shutdown(*it, SHUT_RDWR);
@@ -260,38 +282,112 @@ void Apple1VideoTerminal::writeSockets(uint8_t value) {
             ++it;
         }
     }
+    
+    socketOutput.clear();
 }
 
 /**
- * Writes the specified character to the vector of characters
+ * Queues the specified character for display
+ * Called on the CPU thread, the display is busy until it would have drawn the character,
+ * unless it is in fast mode
  */
 void Apple1VideoTerminal::write(uint8_t value) {
+    if (cpu != NULL && !fastMode.load(memory_order_relaxed)) {
+        readyCycle = cpu->getCycleCount() + CYCLES_PER_CHARACTER;
+        busy = true;
+        
+        // Only the event for the last character written makes the display ready
+        cpu->schedule(readyCycle, [this]() {
+            if (cpu->getCycleCount() >= readyCycle)
+                busy = false;
+        });
+    }
+    
+    // A character written while the queue is full is lost, as on a display that is not ready
+    size_t next = tail.load(memory_order_relaxed);
+    if (next - head.load(memory_order_acquire) == QUEUE_SIZE)
+        return;
+    
+    queue[next & (QUEUE_SIZE - 1)] = value;
+    tail.store(next + 1, memory_order_release);
+    outputCondition.notify_one();
+}
+
+/**
+ * Times the display by the cycles of the given CPU, only used on its thread
+ * Without a CPU, the display is always ready
+ */
+void Apple1VideoTerminal::setCPU(CPU *cpu) {
+    this->cpu = cpu;
+}
+
+/**
+ * Sets whether the display takes characters as fast as they are written, rather than one per frame
+ */
+void Apple1VideoTerminal::setFastMode(bool fast) {
+    fastMode.store(fast, memory_order_relaxed);
+}
+
+/**
+ * Displays the characters written by the CPU as they arrive
+ * Runs on the output thread, sending to the sockets and updating the view once for each batch of characters
+ */
+void Apple1VideoTerminal::process() {
+    unique_lock<mutex> lock(outputMutex);
+    
+    while (!stopping) {
+        size_t next = head.load(memory_order_relaxed);
+        size_t end = tail.load(memory_order_acquire);
+        
+        if (next == end) {
+            outputCondition.wait_for(lock, milliseconds(OUTPUT_TIMEOUT));
+            continue;
+        }
+        
+        lock.unlock();
+        bool full = end - next == QUEUE_SIZE;
+        
+        displayCharactersMutex.lock();
+        for (; next != end; next++) {
+            print(queue[next & (QUEUE_SIZE - 1)]);
+        }
+        displayCharactersMutex.unlock();
+        head.store(end, memory_order_release);
+        
+        // A CPU waiting for room in the queue can go on
+        if (full) {
+            notify();
+        }
+        
+        flushSockets();
+        
+        // Notify callback that display needs updating
+        callback();
+        lock.lock();
+    }
+}
+
+/**
+ * Writes the specified character to the vector of characters and to the output for any open sockets
+ * Called with the display characters locked
+ */
+void Apple1VideoTerminal::print(uint8_t value) {
     // Store original value
     uint8_t rawValue = value;
     
     // Write to any open sockets
-    socketsMutex.lock();
     if (value == 0xd)
         writeSockets('\n');
     else
         writeSockets(value & 0x7f);
-    socketsMutex.unlock();
-    
-    // Start time
-    static nanoseconds behind = nanoseconds(0);
-    high_resolution_clock::time_point start_time = high_resolution_clock::now() - behind;
     
     if (value == 0xd) {     // CR
-        displayCharactersMutex.lock();
-        
         int spaces = 40 - cursorColumn;
         for (int i = 0 ; i < spaces; i++) {
             displayCharacters.push_back(0x20);  // Push CR to the back of the vector
             outputCharacters.push_back(' ');
         }
         
-        displayCharactersMutex.unlock();
-        
         // Move cursor to next row
         if (cursorRow < 23) {
             cursorRow++;
@@ -313,7 +409,6 @@ void Apple1VideoTerminal::write(uint8_t value) {
         if (value >= 0x40)
             value -= 0x20;
         
-        displayCharactersMutex.lock();
         displayCharacters.push_back(value);     // Push the character to the back of the vector
         outputCharacters.push_back(rawValue);
         
@@ -326,9 +421,7 @@ void Apple1VideoTerminal::write(uint8_t value) {
             }
             cursorColumn = 0;
             
-            socketsMutex.lock();
             writeSockets('\n');
-            socketsMutex.unlock();
         }
         
         // Scroll the display
@@ -336,24 +429,7 @@ void Apple1VideoTerminal::write(uint8_t value) {
             displayCharacters.erase(displayCharacters.begin(), displayCharacters.begin() + 40);
             outputCharacters.erase(outputCharacters.begin(), outputCharacters.begin() + 40);
         }
-        displayCharactersMutex.unlock();
     }
-    
-    // Terminal timing
-    high_resolution_clock::time_point end_time = high_resolution_clock::now();
-    nanoseconds exec_time = duration_cast<nanoseconds>(end_time - start_time);
-    
-    // Terminal processes at +/- 60 cps
-    nanoseconds goal_time = nanoseconds(16666667);
-    nanoseconds time_diff = goal_time - exec_time;
-    if (time_diff.count() > 0) {
-        this_thread::sleep_for(nanoseconds(time_diff));
-    }
-    end_time = high_resolution_clock::now();
-    behind = end_time - (start_time + goal_time);
-    
-    // Notify callback that display needs updating
-    callback();
 }
 
 /**
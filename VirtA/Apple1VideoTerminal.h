@@ -31,22 +31,45 @@
 #ifndef Apple1VideoTerminal_H
 #define Apple1VideoTerminal_H
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
+#include "CPU.h"
 #include "Display.h"
 #include "Terminal.h"
 
-class Apple1VideoTerminal: public Terminal {
+class Apple1VideoTerminal final : public Terminal {
+    static const size_t QUEUE_SIZE = 4096;                      // Characters written but not yet displayed, a power of two
+    static const uint_fast32_t CYCLES_PER_CHARACTER = 16667;    // One character per frame of the 60 Hz display at 1 MHz
+    static const uint_fast32_t OUTPUT_TIMEOUT = 10;             // Milliseconds the output thread waits between checks
+    
+    uint8_t queue[QUEUE_SIZE];      // Characters written by the CPU
+    std::atomic<size_t> head;       // Next character to display, advanced by the output thread
+    std::atomic<size_t> tail;       // Next free slot, advanced by the CPU thread
+    std::thread outputThread;
+    std::mutex outputMutex;
+    std::condition_variable outputCondition;
+    std::atomic<bool> stopping;
+    
+    CPU *cpu;                       // Clock the display is timed by
+    uint_fast64_t readyCycle;       // Cycle the display takes its next character at
+    bool busy;                      // Set until readyCycle comes around
+    std::atomic<bool> fastMode;     // Takes characters as fast as they come rather than one per frame
+    
     uint8_t *tempBuffer;
     uint8_t *displayData;
     
     std::vector<uint8_t> displayCharacters;
     std::vector<char> outputCharacters;
+    std::string socketOutput;
     std::vector<int> sockets;
     std::mutex displayCharactersMutex;
     std::mutex socketsMutex;
@@ -59,8 +82,11 @@ class Apple1VideoTerminal: public Terminal {
     
     void update();
     void getCharacter(uint8_t index, uint8_t *character);
+    void process();
+    void print(uint8_t value);
     
     void writeSockets(uint8_t value);
+    void flushSockets();
     void (*callback)();
     
 public:
@@ -69,6 +95,8 @@ public:
     
     uint8_t read();
     void write(uint8_t value);
+    void setCPU(CPU *cpu);
+    void setFastMode(bool fast);
     
     void render(int width, int height);
     void reshape(int width, int height);
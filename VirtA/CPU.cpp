@@ -28,26 +28,145 @@
 //  SOFTWARE.
 //
 
+#include <chrono>
 #include <iostream>
+#include <thread>
+#include <utility>
 
 #include "CPU.h"
 
 using namespace std;
+using namespace chrono;
+
+const uint_fast32_t CPU::SLICE_LENGTH;
+const uint_fast32_t CPU::MAX_LAG;
+const uint_fast32_t CPU::IDLE_TIMEOUT;
+const uint_fast32_t CPU::CLOCK_UNLIMITED;
+
+/**
+ * Returns the time taken to run the given cycles at rate Hz, in whole seconds and the rest so nothing overflows
+ */
+static nanoseconds cycleTime(uint_fast64_t cycles, uint_fast64_t rate) {
+    return seconds(cycles / rate) + nanoseconds(cycles % rate * 1000000000 / rate);
+}
 
 /**
- * Creates a CPU instance linked to a specific MemoryMap instance
+ * Creates a CPU instance linked to a specific MemoryMap instance, running at clockRate Hz
  */
-CPU::CPU(shared_ptr<MemoryMap> memoryMap) : memoryMap(memoryMap) {
+CPU::CPU(shared_ptr<MemoryMap> memoryMap, uint_fast32_t clockRate) : memoryMap(memoryMap), clockRate(clockRate) {
     stopping = false;
+    sliceBudget = 0;
+    clockMultiplier = 1;
+    idlePeriod = 0;
+    sliceCounter = NULL;
+    woken = false;
+    elapsedCycles = 0;
 }
 
 /**
  * Loops to process instructions for the CPU
+ * Instructions run in slices of emulated time, after which the thread sleeps until real time catches up
+ * A slice ends early at the next device event, which runs before the slice that follows
  */
 void CPU::process() {
-    while (!stopping) {
-        execute();  // Pure virtual method to loop
+    uint_fast32_t sliceCycles = clockRate / 1000 * SLICE_LENGTH;
+    uint_fast32_t multiplier = clockMultiplier.load(memory_order_relaxed);
+    
+    // Emulated time is measured from the epoch, so oversleeping is corrected on the next slice
+    steady_clock::time_point epoch = steady_clock::now();
+    uint_fast64_t cycles = 0;
+    
+    while (!stopping.load(memory_order_relaxed)) {
+        scheduler.runUntil(elapsedCycles);
+        
+        uint_fast32_t budget = sliceCycles;
+        uint_fast64_t nextEvent = scheduler.nextEvent();
+        if (nextEvent - elapsedCycles < budget) {
+            budget = static_cast<uint_fast32_t>(nextEvent - elapsedCycles);
+        }
+        
+        uint_fast32_t ran = run(budget);        // Pure virtual method to run a slice
+        sliceCounter = NULL;
+        elapsedCycles += ran;
+        cycles += ran;
+        
+        // Nothing can change until a device or interrupt wakes the CPU
+        if (idlePeriod != 0) {
+            uint_fast64_t parked = park(multiplier);
+            elapsedCycles += parked;
+            cycles += parked;
+        }
+        
+        // Start a new time line when the speed is changed
+        if (clockMultiplier.load(memory_order_relaxed) != multiplier) {
+            multiplier = clockMultiplier.load(memory_order_relaxed);
+            epoch = steady_clock::now();
+            cycles = 0;
+            continue;
+        }
+        
+        if (multiplier == CLOCK_UNLIMITED) {
+            continue;   // Turbo, no pacing
+        }
+        
+        // CPU timing
+        steady_clock::time_point goal_time = epoch + cycleTime(cycles, static_cast<uint_fast64_t>(clockRate) * multiplier);
+        steady_clock::time_point now = steady_clock::now();
+        
+        if (now < goal_time) {
+            this_thread::sleep_until(goal_time);    // Ahead of real time
+        } else if (now - goal_time > milliseconds(MAX_LAG)) {
+            // Too far behind after a host stall, continue from now rather than running flat out to catch up
+            epoch = now;
+            cycles = 0;
+        }
+    }
+}
+
+/**
+ * Blocks the CPU thread while it is spinning in an idle loop, until woken, IDLE_TIMEOUT passes
+ * or the next device event is due
+ * Returns the number of cycles the loop would have run in the meantime, in whole iterations
+ */
+uint_fast64_t CPU::park(uint_fast32_t multiplier) {
+    // Turbo has no clock to fast-forward by, so idle time passes at the native rate
+    uint_fast64_t rate = static_cast<uint_fast64_t>(clockRate) * (multiplier == CLOCK_UNLIMITED ? 1 : multiplier);
+    nanoseconds timeout = milliseconds(IDLE_TIMEOUT);
+    uint_fast64_t deadline = 0;     // Cycles until the next device event, 0 if none is scheduled
+    uint_fast64_t nextEvent = scheduler.nextEvent();
+    
+    if (nextEvent != Scheduler::NO_EVENT) {
+        // An event that fell due in the slice runs first
+        if (nextEvent <= elapsedCycles) {
+            return 0;
+        }
+        
+        deadline = nextEvent - elapsedCycles;
+        
+        // Turbo skips straight to the event
+        if (multiplier == CLOCK_UNLIMITED) {
+            return (deadline + idlePeriod - 1) / idlePeriod * idlePeriod;
+        }
+        
+        timeout = min(timeout, cycleTime(deadline, rate));
+    }
+    
+    steady_clock::time_point start = steady_clock::now();
+    
+    unique_lock<mutex> lock(idleMutex);
+    bool wokenEarly = idleCondition.wait_for(lock, timeout, [this] { return woken || stopping; });
+    woken = false;
+    lock.unlock();
+    
+    uint_fast64_t cycles = duration_cast<nanoseconds>(steady_clock::now() - start).count() * rate / 1000000000;
+    
+    // Resume on the first iteration after the event
+    if (deadline != 0 && !wokenEarly) {
+        cycles = max(cycles, deadline);
+        return (cycles + idlePeriod - 1) / idlePeriod * idlePeriod;
     }
+    
+    return cycles - cycles % idlePeriod;
 }
 
 /**
@@ -62,5 +181,64 @@ void CPU::start() {
  */
 void CPU::stop() {
     stopping = true;
+    wake();
     cpuThread.join();
 }
+
+/**
+ * Ends the running slice after the current instruction
+ * Used to have interrupts and device events handled without waiting for the slice to finish
+ */
+void CPU::requestExit() {
+    sliceBudget.store(0, memory_order_relaxed);
+}
+
+/**
+ * Resumes a CPU parked in an idle loop
+ * Called by devices when their state changes
+ */
+void CPU::wake() {
+    lock_guard<mutex> lock(idleMutex);
+    woken = true;
+    idleCondition.notify_one();
+}
+
+/**
+ * Has the callback run when the CPU reaches the given cycle
+ * Called by devices on the CPU thread, the running slice ends in time for the event
+ */
+void CPU::schedule(uint_fast64_t cycle, function<void()> callback) {
+    scheduler.schedule(cycle, move(callback));
+    
+    if (sliceCounter == NULL)
+        return;
+    
+    // Only ever lower the budget, so an exit requested by another thread meanwhile is kept
+    uint_fast64_t budget = cycle > elapsedCycles ? cycle - elapsedCycles : 0;
+    uint_fast32_t current = sliceBudget.load(memory_order_relaxed);
+    while (budget < current &&
+           !sliceBudget.compare_exchange_weak(current, static_cast<uint_fast32_t>(budget), memory_order_relaxed)) { }
+}
+
+/**
+ * Returns the number of cycles run since the CPU was started, up to the instruction being run
+ * Only meaningful on the CPU thread, such as in a device the CPU is accessing
+ */
+uint_fast64_t CPU::getCycleCount() {
+    return elapsedCycles + (sliceCounter != NULL ? *sliceCounter : 0);
+}
+
+/**
+ * Sets the emulated clock speed as a multiple of the native clock rate
+ * CLOCK_UNLIMITED runs as fast as the host allows. Takes effect from the next slice.
+ */
+void CPU::setClockMultiplier(uint_fast32_t multiplier) {
+    clockMultiplier.store(multiplier, memory_order_relaxed);
+}
+
+/**
+ * Returns the emulated clock speed as a multiple of the native clock rate
+ */
+uint_fast32_t CPU::getClockMultiplier() {
+    return clockMultiplier.load(memory_order_relaxed);
+}
@@ -31,25 +31,55 @@
 #define CPU_H
 
 #include "MemoryMap.h"
+#include "Scheduler.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 
+#include <cstdint>
+
 class CPU {
     void process();
+    uint_fast64_t park(uint_fast32_t multiplier);
     std::thread cpuThread;
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+    bool woken;                                 // Set by wake(), guarded by idleMutex
+    uint_fast64_t elapsedCycles;                // Cycles run before the current slice
+    Scheduler scheduler;                        // Device events, run between slices
     
 protected:
     std::shared_ptr<MemoryMap> memoryMap;
-    virtual void execute() = 0;
-    bool stopping;
+    std::atomic<bool> stopping;
+    std::atomic<uint_fast32_t> sliceBudget;     // Cycle budget of the running slice
+    uint_fast32_t clockRate;                    // Emulated clock rate in Hz
+    std::atomic<uint_fast32_t> clockMultiplier; // Speed relative to clockRate
+    uint_fast32_t idlePeriod;                   // Cycles per iteration when a slice ends in an idle loop, otherwise 0
+    const uint_fast32_t *sliceCounter;          // Cycle count of the running slice, set by run()
+    
+    static const uint_fast32_t SLICE_LENGTH = 5;    // Emulated milliseconds per slice
+    static const uint_fast32_t MAX_LAG = 50;        // Milliseconds behind real time before catch-up is abandoned
+    static const uint_fast32_t IDLE_TIMEOUT = 100;  // Milliseconds parked before an idle loop is run again
     
 public:
-    CPU(std::shared_ptr<MemoryMap> memoryMap);
+    static const uint_fast32_t CLOCK_UNLIMITED = 0;     // Clock multiplier for running unthrottled
+    
+    CPU(std::shared_ptr<MemoryMap> memoryMap, uint_fast32_t clockRate);
     virtual ~CPU() { };
     void start();
     void stop();
     virtual void reset() = 0;
+    virtual uint_fast32_t run(uint_fast32_t cycleBudget) = 0;
+    void requestExit();
+    void wake();
+    void schedule(uint_fast64_t cycle, std::function<void()> callback);
+    uint_fast64_t getCycleCount();
+    void setClockMultiplier(uint_fast32_t multiplier);
+    uint_fast32_t getClockMultiplier();
     void wait();
 };
 
@@ -33,9 +33,13 @@
 
 #include <cstdio>
 
+#include "StateArena.h"
 #include "MemoryMap.h"
 #include "MOS6502.h"
+#include "MOS6502Recompiler.h"
 #include "Motorola6820.h"
+#include "Apple1Bus.h"
+#include "Machine.h"
 #include "PETIO.h"
 #include "ASCIIKeyboard.h"
 #include "VideoOutput.h"
@@ -58,6 +62,8 @@
 - (void) reshape: (NSRect) bounds;
 - (void) keyInput: (NSString *) characters;
 - (void) reset;
+- (void) setSpeed: (NSUInteger) multiplier;
+- (void) setFastTerminal: (BOOL) fast;
 - (NSString *) getCharacters;
 
 @end
@@ -36,19 +36,20 @@ using namespace chrono;
 
 static MainViewController *_viewController;
 
+// The devices of the Apple I never change, so they are wired together at compile time
+typedef Machine<MOS6502, Apple1Bus<ASCIIKeyboard, Apple1VideoTerminal>> Apple1;
+
 void displayCallback() {
     [_viewController updateView];
 }
 
 @implementation Emulator
 {
-    shared_ptr<MemoryMap> memoryMap;
-    shared_ptr<CPU> cpu;
+    unique_ptr<Apple1> apple1;
     shared_ptr<ASCIIKeyboard> keyboard;
     shared_ptr<Terminal> terminal;
     shared_ptr<VideoOutput> output;
     shared_ptr<TelnetServer> telnetServer;
-    MemoryInterface *io;
     NSTimer *displayTimer;
 
 #ifdef DEBUG
@@ -74,34 +75,44 @@ void displayCallback() {
     
     if (self) {
         // Apple I emulation
-        memoryMap = shared_ptr<MemoryMap>(new MemoryMap(8, 0xe000));
-        
-        // wozmon.rom assembled from Jeff Tranter's code at https://github.com/jefftranter/6502/tree/master/asm/wozmon
-        // Original code by Stephen Wozniak (http://www.woz.org)
-        NSString *wmPath = [[NSBundle mainBundle] pathForResource:@"wozmon" ofType:@"rom"];
-        memoryMap->loadROM(0xff00, [wmPath UTF8String]);
-        
         keyboard = shared_ptr<ASCIIKeyboard>(new ASCIIKeyboard());
         
-        terminal = shared_ptr<Terminal>(new Apple1VideoTerminal(displayCallback));
+        shared_ptr<Apple1VideoTerminal> videoTerminal(new Apple1VideoTerminal(displayCallback));
+        terminal = videoTerminal;
         output = terminal;
         
-        io = new Motorola6820(0xd000, keyboard, terminal);
-        memoryMap->registerInterface(io);
+        // The machine's state is kept together, apart from RAM, which can be kept in a file between runs
+        NSString *ramPath = [[NSUserDefaults standardUserDefaults] stringForKey:@"RAMFile"];
+        
+        // The recompiler is opt-in, as the interpreter remains the reference
+        bool recompile = [[NSUserDefaults standardUserDefaults] boolForKey:@"UseRecompiler"] && MOS6502Recompiler::isSupported();
+        Apple1::CoreFactory makeCore = [recompile](shared_ptr<MemoryMap> memoryMap, StateArena *arena) -> MOS6502 * {
+            if (recompile)
+                return new MOS6502Recompiler(memoryMap, arena);
+            return new MOS6502(memoryMap, arena);
+        };
+        
+        // wozmon.rom assembled from Jeff Tranter's code at https://github.com/jefftranter/6502/tree/master/asm/wozmon
+        // Original code by Stephen Wozniak (http://www.woz.org)
+        NSString *wmPath = [[NSBundle mainBundle] pathForResource:@"wozmon" ofType:@"rom"];
+        apple1 = unique_ptr<Apple1>(new Apple1(ramPath != nil ? [ramPath UTF8String] : "", makeCore,
+                                               keyboard, videoTerminal, string([wmPath UTF8String])));
         
 #ifdef DEBUG
         // wozaci.rom assembled from Jeff Tranter's code at https://github.com/jefftranter/6502/tree/master/asm/wozaci
         // Original code by Stephen Wozniak (http://www.woz.org)
         NSString *waPath = [[NSBundle mainBundle] pathForResource:@"wozaci" ofType:@"rom"];
         aci = new ACI(0xc000, [waPath UTF8String]); // ACI emulation doesn't work
-        memoryMap->registerInterface(aci);
+        apple1->getMemoryMap().registerInterface(aci);
 #endif
         
         telnetServer = shared_ptr<TelnetServer>(new TelnetServer(keyboard, terminal, "2121"));
         telnetServer->start();
         
-        cpu = shared_ptr<CPU>(new MOS6502(memoryMap));
-        cpu->start();
+        // The display takes characters at its own pace in emulated time, unless set to keep up with the CPU
+        videoTerminal->setFastMode([[NSUserDefaults standardUserDefaults] boolForKey:@"FastTerminal"]);
+        
+        apple1->start();
         
         displayTimer = [NSTimer scheduledTimerWithTimeInterval:output->timerDuration() target:self selector:@selector(displayTimerTrigger:) userInfo:nil repeats:YES];
     }
@@ -113,14 +124,12 @@ void displayCallback() {
  * Shuts down the emulation
  */
 - (void) dealloc {
-    cpu->stop();
+    apple1.reset();     // Stops the CPU and disconnects it from the devices, which the telnet server still uses
     telnetServer->stop();
     
 #ifdef DEBUG
     delete aci;
 #endif
-    
-    delete io;
 }
 
 /**
@@ -148,7 +157,21 @@ void displayCallback() {
  * Simulates pressing the reset button
  */
 - (void) reset {
-    cpu->reset();
+    apple1->getCPU().reset();
+}
+
+/**
+ * Sets the emulation speed as a multiple of the original clock, 0 for unlimited
+ */
+- (void) setSpeed: (NSUInteger) multiplier {
+    apple1->getCPU().setClockMultiplier((uint_fast32_t)multiplier);
+}
+
+/**
+ * Sets whether the terminal takes characters as fast as they are written, rather than at 60 per second
+ */
+- (void) setFastTerminal: (BOOL) fast {
+    apple1->getBus().getTerminal()->setFastMode(fast);
 }
 
 /**
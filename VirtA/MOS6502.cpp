@@ -29,25 +29,30 @@
 //
 
 #include <algorithm>
-#include <chrono>
+#include <atomic>
 #include <memory>
 
 #include "MOS6502.h"
 
 using namespace std;
-using namespace chrono;
 
 /**
- * Initializes the CPU
+ * Initializes the CPU, keeping its registers in the machine's state arena if it has one
  */
-MOS6502::MOS6502(shared_ptr<MemoryMap> memoryMap) : CPU(memoryMap) {
+MOS6502::MOS6502(shared_ptr<MemoryMap> memoryMap, StateArena *arena)
+    : CPU(memoryMap, 1000000), registers(allocateState(arena, ownRegisters)),
+      interruptLines(INT_NONE) {
     // Default values
     registers.A = 0xaa;
     registers.X = 0xc0;
     registers.Y = 0x00;
     registers.S = 0xbb;
     registers.PC = 0x0;
-    registers.P = 0x20 | FLAG_B | FLAG_I | FLAG_Z;  // Bit 5 is always set
+    setP(registers, 0x20 | FLAG_B | FLAG_I | FLAG_Z);   // Bit 5 is always set
+    
+    // Nothing decoded yet, and writes to code drop what has been
+    decodeCache.resize(0x10000, DecodedInstruction());
+    memoryMap->setCodeListener([this](uint16_t address) { invalidate(address); });
     
     reset();    // Trigger a RESET
 }
@@ -56,934 +61,1418 @@ MOS6502::MOS6502(shared_ptr<MemoryMap> memoryMap) : CPU(memoryMap) {
  * Frees memory used by the CPU implementation
  */
 MOS6502::~MOS6502() {
-    
+    memoryMap->setCodeListener(nullptr);
 }
 
 /**
- * Reads a pointer according to the specified addressing mode
- */
-uint16_t MOS6502::readPtr(AddressingMode addressingMode) {
-    uint16_t value;
-    
-    switch (addressingMode) {
-        case AM_IMM:    // #immediate
-            return newPC++;
-        case AM_ACC:    // accumulator
-            return NULL;    // not possible
-        case AM_ABS:    // abs
-            value = memoryMap->readWord(newPC++);
-            newPC++;     // value is 2 bytes long
-            return value;
-        case AM_ABS_X:  // abs,X
-            value = memoryMap->readWord(newPC++) + registers.X;
-            newPC++;     // value is 2 bytes long
-            return value;
-        case AM_ABS_Y:  // abs,Y
-            value = memoryMap->readWord(newPC++) + registers.Y;
-            newPC++;     // value is 2 bytes long
-            return value;
-        case AM_ZP:     // zp
-            return static_cast<uint16_t>(memoryMap->readByte(newPC++));
-        case AM_ZP_X:   // zp,X
-            return (static_cast<uint16_t>(memoryMap->readByte(newPC++)) + static_cast<uint16_t>(registers.X)) & 0xff;
-        case AM_ZP_Y:   // zp,Y
-            return (static_cast<uint16_t>(memoryMap->readByte(newPC++)) + static_cast<uint16_t>(registers.Y)) & 0xff;
-        case AM_ZP_X_IND:   // (zp,X)
-            return memoryMap->readWord((static_cast<uint16_t>(memoryMap->readByte(newPC++)) +
-                                        static_cast<uint16_t>(registers.X)) & 0xff);
-        case AM_ZP_IND_X:   // (zp),X
-            return memoryMap->readWord(static_cast<uint16_t>(memoryMap->readByte(newPC++))) +
-                                       static_cast<uint16_t>(registers.X);
-        case AM_ZP_IND_Y:   // (zp),Y
-            return memoryMap->readWord(static_cast<uint16_t>(memoryMap->readByte(newPC++))) +
-                                       static_cast<uint16_t>(registers.Y);
+ * Fetches another operand from after the current one, advancing PC past it
+ * Used by undocumented opcodes that run two operations, each reading an operand.
+ */
+template<MOS6502::AddressingMode mode>
+inline void MOS6502::fetchOperand(Registers &r) {
+    if (mode == AM_ABS || mode == AM_ABS_X || mode == AM_ABS_Y) {
+        operand = memoryMap->readWord(r.PC);
+        r.PC += 2;
+    } else if (mode != AM_ACC) {
+        operand = memoryMap->readByte(r.PC++);
     }
 }
 
 /**
- * Reads a value according to the specified addressing mode
+ * Reads a pointer according to the addressing mode, from the operand of the instruction
+ * Specialized per addressing mode, so each handler computes its address without branching on the mode
  */
-uint8_t MOS6502::readValue(AddressingMode addressingMode) {
-    switch (addressingMode) {
-        case AM_ACC:
-            return registers.A;
-        default:
-            return memoryMap->readByte(readPtr(addressingMode));
-    }
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_IMM>(Registers &r) {     // #immediate
+    return r.PC - 1;    // PC is already past the operand
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ACC>(Registers &) {      // accumulator
+    return 0;   // not possible
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ABS>(Registers &) {      // abs
+    return operand;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ABS_X>(Registers &r) {   // abs,X
+    return operand + r.X;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ABS_Y>(Registers &r) {   // abs,Y
+    return operand + r.Y;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP>(Registers &) {       // zp
+    return operand;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP_X>(Registers &r) {    // zp,X
+    return (operand + static_cast<uint16_t>(r.X)) & 0xff;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP_Y>(Registers &r) {    // zp,Y
+    return (operand + static_cast<uint16_t>(r.Y)) & 0xff;
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP_X_IND>(Registers &r) {    // (zp,X)
+    return memoryMap->readWord((operand + static_cast<uint16_t>(r.X)) & 0xff);
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP_IND_X>(Registers &r) {    // (zp),X
+    return memoryMap->readWord(operand) + static_cast<uint16_t>(r.X);
+}
+
+template<>
+inline uint16_t MOS6502::readPtr<MOS6502::AM_ZP_IND_Y>(Registers &r) {    // (zp),Y
+    return memoryMap->readWord(operand) + static_cast<uint16_t>(r.Y);
 }
 
 /**
- * Writes a value according to the specified addresing mode
+ * Reads a value according to the addressing mode
  */
-void MOS6502::writeValue(AddressingMode addressingMode, uint8_t value) {
-    switch (addressingMode) {
-        case AM_IMM:    // #immediate
-            break;      // not possible
-        case AM_ACC:    // accumulator
-            registers.A = value;
-            break;
-        default:    // abs
-            memoryMap->writeByte(readPtr(addressingMode), value);
-            break;
-    }
+template<MOS6502::AddressingMode mode>
+inline uint8_t MOS6502::readValue(Registers &r) {
+    return memoryMap->readByte(readPtr<mode>(r));
+}
+
+template<>
+inline uint8_t MOS6502::readValue<MOS6502::AM_IMM>(Registers &) {
+    return static_cast<uint8_t>(operand);
+}
+
+template<>
+inline uint8_t MOS6502::readValue<MOS6502::AM_ACC>(Registers &r) {
+    return r.A;
+}
+
+/**
+ * Writes a value according to the addressing mode
+ */
+template<MOS6502::AddressingMode mode>
+inline void MOS6502::writeValue(Registers &r, uint8_t value) {
+    memoryMap->writeByte(readPtr<mode>(r), value);
+}
+
+template<>
+inline void MOS6502::writeValue<MOS6502::AM_IMM>(Registers &, uint8_t) {
+    // not possible
+}
+
+template<>
+inline void MOS6502::writeValue<MOS6502::AM_ACC>(Registers &r, uint8_t value) {
+    r.A = value;
 }
 
 /**
  * Pushes a value onto the stack
  */
-void MOS6502::push(uint8_t value) {
-    memoryMap->writeByte(static_cast<uint16_t>(registers.S--) | 0x100, value);
+void MOS6502::push(Registers &r, uint8_t value) {
+    memoryMap->writeByte(static_cast<uint16_t>(r.S--) | 0x100, value);
 }
 
 /**
  * Pops a value from the stack
  */
-uint8_t MOS6502::pop() {
-    return memoryMap->readByte(static_cast<uint16_t>(++registers.S) | 0x100);
+uint8_t MOS6502::pop(Registers &r) {
+    return memoryMap->readByte(static_cast<uint16_t>(++r.S) | 0x100);
 }
 
 /**
  * Sets N and Z flags according to value
+ * The value is kept and only turned into flags when they are read
+ */
+void MOS6502::setNZ(Registers &r, uint8_t value) {
+    r.resultN = value;
+    r.resultZ = value;
+}
+
+/**
+ * Returns the processor flags, as pushed on the stack
  */
-void MOS6502::setNZ(uint8_t value) {
-    if ((value & 0x80) == 0x80)   // Check negative
-        registers.P |= FLAG_N;
-    else
-        registers.P &= ~FLAG_N;
+uint8_t MOS6502::getP(const Registers &r) {
+    uint8_t value = r.P & ~(FLAG_N | FLAG_V | FLAG_Z | FLAG_C);
+    
+    value |= r.resultN & FLAG_N;
+    value |= (r.overflow >> 1) & FLAG_V;
+    value |= r.carry & FLAG_C;
+    if (r.resultZ == 0)
+        value |= FLAG_Z;
     
-    if (value == 0x0)   // Check zero
-        registers.P |= FLAG_Z;
-    else
-        registers.P &= ~FLAG_Z;
+    return value;
+}
+
+/**
+ * Sets the processor flags, as pulled from the stack
+ */
+void MOS6502::setP(Registers &r, uint8_t value) {
+    r.P = value;
+    r.resultN = value;
+    r.resultZ = ~value & FLAG_Z;
+    r.carry = value & FLAG_C;
+    r.overflow = value << 1;
+}
+
+/**
+ * Returns whether one of the processor flags is set, without assembling the others
+ */
+template<uint8_t flag>
+bool MOS6502::isFlagSet(const Registers &r) {
+    switch (flag) {
+        case FLAG_N:
+            return (r.resultN & 0x80) != 0;
+        case FLAG_V:
+            return (r.overflow & 0x80) != 0;
+        case FLAG_Z:
+            return r.resultZ == 0;
+        case FLAG_C:
+            return r.carry != 0;
+        default:
+            return (r.P & flag) != 0;
+    }
 }
 
 /**
- * Executes a set of CPU instructions.
+ * Decimal format conversion of a binary sum, adjusting the low digit on a carry out of it
+ * and the high digit when it is above 9
  */
-void MOS6502::execute() {
-    // Start time
-    static high_resolution_clock::time_point start_time = high_resolution_clock::now();
+static constexpr uint16_t decimalAdjustHigh(uint16_t value16) {
+    return (value16 & 0xf0) > 0x90 ? value16 + 0x60 : value16;
+}
+
+static constexpr uint16_t decimalAdjust(uint16_t index) {
+    // Index is the binary sum in bits 0-8 and the carry out of the low digit in bit 9
+    return decimalAdjustHigh((index & 0x1ff) + ((index & 0x200) != 0 ? 0x6 : 0x0));
+}
+
+/**
+ * Adds a value and the carry flag to the accumulator
+ * SBC is performed by passing the one's complement of its operand
+ */
+void MOS6502::addWithCarry(Registers &r, uint8_t value8) {
+    // Decimal results for every binary sum (including the carry) and carry out of the low digit
+#define DECIMAL_ADJUST_4(index) decimalAdjust(index), decimalAdjust(index + 1), \
+    decimalAdjust(index + 2), decimalAdjust(index + 3)
+#define DECIMAL_ADJUST_16(index) DECIMAL_ADJUST_4(index), DECIMAL_ADJUST_4(index + 4), \
+    DECIMAL_ADJUST_4(index + 8), DECIMAL_ADJUST_4(index + 12)
+#define DECIMAL_ADJUST_64(index) DECIMAL_ADJUST_16(index), DECIMAL_ADJUST_16(index + 16), \
+    DECIMAL_ADJUST_16(index + 32), DECIMAL_ADJUST_16(index + 48)
+#define DECIMAL_ADJUST_256(index) DECIMAL_ADJUST_64(index), DECIMAL_ADJUST_64(index + 64), \
+    DECIMAL_ADJUST_64(index + 128), DECIMAL_ADJUST_64(index + 192)
+    static constexpr uint16_t decimalMap[] = {DECIMAL_ADJUST_256(0x0), DECIMAL_ADJUST_256(0x100),
+        DECIMAL_ADJUST_256(0x200), DECIMAL_ADJUST_256(0x300)};
+#undef DECIMAL_ADJUST_256
+#undef DECIMAL_ADJUST_64
+#undef DECIMAL_ADJUST_16
+#undef DECIMAL_ADJUST_4
     
-    // Working copy of PC
-    newPC = registers.PC;
+    // Calculation
+    uint16_t value16 = static_cast<uint16_t>(r.A) + static_cast<uint16_t>(value8) + r.carry;
     
-    // Opcode to be executed
-    uint8_t opcode;
+    if ((r.P & FLAG_D) == FLAG_D) { // Handle decimal mode
+        value16 = decimalMap[((r.A ^ value8 ^ value16) & 0x10) << 5 | value16];
+    }
     
-    // Check for an interrupt, ignoring IRQ if interrupt flag is set
-    if (pendingInterrupt == INT_NONE || (pendingInterrupt == INT_IRQ && (registers.P & FLAG_I) == FLAG_I))
-        opcode = memoryMap->readByte(newPC++);  // Get the next opcode
-    else
-        opcode = 0x0;   // Simulate BRK for interrupt
-    
-    uint_fast8_t cycles = getCycles(opcode);    // Minimum 2 cycles
-    
-    // Break the opcode down into manageable parts
-    uint_fast8_t opcodeGroup = opcode & 0x3;
-    uint_fast8_t opcodeInstruction = (opcode & 0xe0) >> 5;
-    uint_fast8_t opcodeMode = (opcode & 0x1c) >> 2;
-        
-    AddressingMode addressingMode = AM_IMM;     // Needs to be initialized to something
-    
-    uint8_t value8;     // Temporary storage for byte
-    uint16_t value16;   // Temporary storage for word
-    int16_t svalue16;   // Temporary storage for signed word
-    bool boolValue;     // Temporary storage for boolean
-    
-    switch (opcodeGroup) {
-        case 0x1:   // Most common opcodes
-        case 0x3:   // Both bits set
-            switch (opcodeMode) {
-                case 0x0:   // (zp,X)
-                    addressingMode = AM_ZP_X_IND;
-                    break;
-                case 0x1:   // zp
-                    addressingMode = AM_ZP;
-                    break;
-                case 0x2:   // #immediate
-                    addressingMode = AM_IMM;
-                    break;
-                case 0x3:   // abs
-                    addressingMode = AM_ABS;
-                    break;
-                case 0x4:   // (zp),Y
-                    addressingMode = AM_ZP_IND_Y;
-                    break;
-                case 0x5:   // zp,X
-                    addressingMode = AM_ZP_X;
-                    break;
-                case 0x6:   // abs,Y
-                    addressingMode = AM_ABS_Y;
-                    break;
-                case 0x7:   // abs,X
-                    addressingMode = AM_ABS_X;
-                    break;
-            }
-            
-            switch (opcodeInstruction) {
-                case 0x0:   // ORA
-                    registers.A |= readValue(addressingMode);   // OR A
-                    
-                    setNZ(registers.A);
-                    
-                    break;
-                case 0x1:   // AND
-                    registers.A &= readValue(addressingMode);   // AND A
-                    
-                    setNZ(registers.A);
-                    
-                    break;
-                case 0x2:   // EOR
-                    registers.A ^= readValue(addressingMode);   // XOR A
-                    
-                    setNZ(registers.A);
-                    
-                    break;
-                case 0x4:   // STA
-                    if (opcodeMode != 0x2) {    // #immediate is invalid for STA
-                        writeValue(addressingMode, registers.A);
-                    }
-                    break;
-                case 0x5:   // LDA
-                    registers.A = readValue(addressingMode);
-                    
-                    setNZ(registers.A);
-                    
-                    break;
-                case 0x6:   // CMP
-                    value8 = readValue(addressingMode);
-                    
-                    // Store result in a larger variable to determine carry
-                    svalue16 = static_cast<int8_t>(registers.A) - static_cast<int8_t>(value8);
-                    
-                    setNZ(svalue16);
-                    
-                    if (registers.A < value8) { // Check carry
-                        registers.P &= ~FLAG_C;
-                    } else {
-                        registers.P |= FLAG_C;
-                    }
-                    
-                    break;
-            }
-            
-            // ADC and SBC are fairly complex, yet very similar
-            if (opcodeInstruction == 0x3 || opcodeInstruction == 0x7) {     // ADC or SBC
-                if (opcodeInstruction == 0x3) { // ADC
-                    value8 = static_cast<uint16_t>(readValue(addressingMode));   // Take normal value
-                } else {    // SBC
-                    value8 = static_cast<uint16_t>(~readValue(addressingMode));  // Take one's complement of value
-                }
-                
-                // Calculation
-                value16 = static_cast<uint16_t>(registers.A) + static_cast<uint16_t>(value8);
-                
-                if ((registers.P & FLAG_C) == FLAG_C) {  // Check carry flag
-                    value16++;
-                }
-                
-                if ((registers.P & FLAG_D) == FLAG_D) { // Handle decimal mode
-                    // Decimal format conversion
-                    if (((registers.A ^ value8 ^ value16) & 0x10) == 0x10)
-                        value16 += 0x6;
-                    if ((value16 & 0xf0) > 0x90)
-                        value16 += 0x60;
-                }
-                
-                if (((registers.A ^ value16) & (value8 ^ value16) & 0x80) == 0x80) { // Check overflow
-                    registers.P |= FLAG_V;
-                } else {
-                    registers.P &= ~FLAG_V;
-                }
-                
-                setNZ(static_cast<uint8_t>(value16));
-                
-                if ((value16 & 0xff00) == 0) {  // Check carry
-                    registers.P &= ~FLAG_C;
-                } else {
-                    registers.P |= FLAG_C;
-                }
-                
-                registers.A = static_cast<uint8_t>(value16 & 0xff);    // Store result
-            }
-            break;
+    r.overflow = (r.A ^ value16) & (value8 ^ value16);  // Overflow in bit 7
+    
+    setNZ(r, static_cast<uint8_t>(value16));
+    
+    r.carry = (value16 & 0xff00) != 0;
+    
+    r.A = static_cast<uint8_t>(value16 & 0xff);    // Store result
+}
+
+/**
+ * ORA: OR memory with accumulator
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opORA(Registers &r) {
+    r.A |= readValue<mode>(r);   // OR A
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * AND: AND memory with accumulator
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opAND(Registers &r) {
+    r.A &= readValue<mode>(r);   // AND A
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * EOR: XOR memory with accumulator
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opEOR(Registers &r) {
+    r.A ^= readValue<mode>(r);   // XOR A
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * ADC: Add memory to accumulator with carry
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opADC(Registers &r) {
+    addWithCarry(r, readValue<mode>(r));    // Take normal value
+}
+
+/**
+ * STA: Store accumulator in memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opSTA(Registers &r) {
+    writeValue<mode>(r, r.A);
+}
+
+/**
+ * LDA: Load accumulator from memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opLDA(Registers &r) {
+    r.A = readValue<mode>(r);
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * CMP: Compare memory with accumulator
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opCMP(Registers &r) {
+    uint8_t value8 = readValue<mode>(r);
+    
+    // Store result in a larger variable to determine carry
+    int16_t svalue16 = static_cast<int8_t>(r.A) - static_cast<int8_t>(value8);
+    
+    setNZ(r, svalue16);
+    
+    r.carry = r.A >= value8;
+}
+
+/**
+ * SBC: Subtract memory from accumulator with borrow
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opSBC(Registers &r) {
+    addWithCarry(r, ~readValue<mode>(r));   // Take one's complement of value
+}
+
+/**
+ * ASL: Shift left one bit (memory or accumulator)
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opASL(Registers &r) {
+    if (mode == AM_ACC) {
+        r.carry = r.A >> 7;
+        
+        r.A <<= 1;  // Shift left
+        
+        setNZ(r, r.A);
+    } else {
+        uint16_t value16 = readPtr<mode>(r);    // Read from memory
+        uint8_t value8 = memoryMap->readByte(value16);
+        
+        r.carry = value8 >> 7;
+        
+        value8 <<= 1;   // Shift left
+        
+        memoryMap->writeByte(value16, value8);  // Write back to memory
+        
+        setNZ(r, value8);
+    }
+}
+
+/**
+ * ROL: Rotate one bit left (memory or accumulator)
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opROL(Registers &r) {
+    bool carry;
+    
+    if (mode == AM_ACC) {
+        carry = (r.A & 0x80) == 0x80;   // Check for carry
+        
+        r.A = (r.A << 1) | r.carry;  // Shift left with carry
+        
+        setNZ(r, r.A);
+    } else {
+        uint16_t value16 = readPtr<mode>(r);    // Read from memory
+        uint8_t value8 = memoryMap->readByte(value16);
+        
+        carry = (value8 & 0x80) == 0x80;    // Check for carry
+        
+        value8 = (value8 << 1) | r.carry;    // Shift left with carry
+        
+        memoryMap->writeByte(value16, value8);  // Write back to memory
+        
+        setNZ(r, value8);
+    }
+    
+    r.carry = carry;
+}
+
+/**
+ * LSR: Shift one bit right (memory or accumulator)
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opLSR(Registers &r) {
+    if (mode == AM_ACC) {
+        r.carry = r.A & 0x1;
+        
+        r.A >>= 1;  // Shift right
+        
+        setNZ(r, r.A);
+    } else {
+        uint16_t value16 = readPtr<mode>(r);    // Read from memory
+        uint8_t value8 = memoryMap->readByte(value16);
+        
+        r.carry = value8 & 0x1;
+        
+        value8 >>= 1;   // Shift right
+        
+        memoryMap->writeByte(value16, value8);  // Write back to memory
+        
+        r.resultZ = value8;     // Only Z is changed
+    }
+}
+
+/**
+ * ROR: Rotate one bit right (memory or accumulator)
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opROR(Registers &r) {
+    bool carry;
+    
+    if (mode == AM_ACC) {
+        carry = (r.A & 0x1) == 0x1;     // Check for carry
+        
+        r.A = (r.A >> 1) | (r.carry << 7);   // Shift right with carry
+        
+        setNZ(r, r.A);
+    } else {
+        uint16_t value16 = readPtr<mode>(r);    // Read from memory
+        uint8_t value8 = memoryMap->readByte(value16);
+        
+        carry = (value8 & 0x1) == 0x1;  // Check for carry
+        
+        value8 = (value8 >> 1) | (r.carry << 7); // Shift right with carry
+        
+        memoryMap->writeByte(value16, value8);  // Write back to memory
+        
+        setNZ(r, value8);
+    }
+    
+    r.carry = carry;
+}
+
+/**
+ * STX: Store index X in memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opSTX(Registers &r) {
+    writeValue<mode>(r, r.X);
+}
+
+/**
+ * LDX: Load index X from memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opLDX(Registers &r) {
+    r.X = readValue<mode>(r);
+    
+    setNZ(r, r.X);
+}
+
+/**
+ * DEC: Decrement memory by one
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opDEC(Registers &r) {
+    // Get the address
+    uint16_t value16 = readPtr<mode>(r);
+    uint8_t value8 = memoryMap->readByte(value16) - 1;
+    
+    setNZ(r, value8);
+    
+    // Decrement the value
+    memoryMap->writeByte(value16, value8);
+}
+
+/**
+ * INC: Increment memory by one
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opINC(Registers &r) {
+    // Get the address
+    uint16_t value16 = readPtr<mode>(r);
+    uint8_t value8 = memoryMap->readByte(value16) + 1;
+    
+    setNZ(r, value8);
+    
+    // Increment the value
+    memoryMap->writeByte(value16, value8);
+}
+
+/**
+ * BIT: Test bits in memory with accumulator
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opBIT(Registers &r) {
+    uint8_t value8 = readValue<mode>(r);
+    
+    r.resultN = value8;         // Negative from bit 7
+    r.overflow = value8 << 1;   // Overflow from bit 6
+    r.resultZ = value8 & r.A;   // Logical AND with accumulator
+}
+
+/**
+ * JMP: Jump to new location
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opJMP(Registers &r) {
+    // Update PC to new address
+    r.PC = readPtr<mode>(r);
+}
+
+/**
+ * JMP (abs): Jump to the location stored at the operand address
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opJMPIndirect(Registers &r) {
+    // Update PC to new address
+    r.PC = memoryMap->readWord(readPtr<mode>(r));
+    
+    memoryMap->dumpMonitor(0x20, 2);
+}
+
+/**
+ * STY: Store index Y in memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opSTY(Registers &r) {
+    writeValue<mode>(r, r.Y);
+}
+
+/**
+ * LDY: Load index Y from memory
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opLDY(Registers &r) {
+    r.Y = readValue<mode>(r);
+    
+    setNZ(r, r.Y);
+}
+
+/**
+ * CPY: Compare memory and index Y
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opCPY(Registers &r) {
+    uint8_t value8 = readValue<mode>(r);
+    
+    // Store result in a larger variable to determine carry
+    int16_t svalue16 = static_cast<int8_t>(r.Y) - static_cast<int8_t>(value8);
+    
+    r.resultN = svalue16 < 0 ? FLAG_N : 0;  // Negative from the sign of the difference
+    r.resultZ = svalue16 != 0;
+    r.carry = svalue16 >= value8;
+}
+
+/**
+ * CPX: Compare memory and index X
+ */
+template<MOS6502::AddressingMode mode>
+void MOS6502::opCPX(Registers &r) {
+    uint8_t value8 = readValue<mode>(r);
+    
+    // Store result in a larger variable to determine carry
+    int16_t svalue16 = static_cast<int8_t>(r.X) - static_cast<int8_t>(value8);
+    
+    setNZ(r, svalue16);
+    
+    r.carry = r.A >= value8;
+}
+
+/**
+ * Conditional branch, taken when the flag matches the expected state
+ */
+template<uint8_t flag, bool set>
+void MOS6502::opBranch(Registers &r, uint_fast32_t &cycles) {
+    if (isFlagSet<flag>(r) == set) {
+        cycles++;
+        uint8_t value8 = static_cast<uint8_t>(operand);
+        // Check for page boundary cross
+        if (((r.PC + static_cast<int8_t>(value8)) & 0xff00) !=
+            (r.PC & 0xff00)) {
+            cycles++;
+        }
+        r.PC += static_cast<int8_t>(value8);
+        
+        // A short loop back may be polling a device
+        if (static_cast<int8_t>(value8) < 0 && static_cast<int8_t>(value8) >= -MAX_IDLE_LOOP) {
+            checkIdleLoop(r, cycles, r.PC - static_cast<int8_t>(value8) - 2);
+        }
+    }
+}
+
+/**
+ * BRK: Force break
+ * pc is the address the instruction was fetched from
+ */
+void MOS6502::opBRK(Registers &r, uint16_t pc) {
+    enterInterrupt(r, pc, INT_BRK);
+}
+
+/**
+ * Enters the handler for an interrupt, as BRK does for the software interrupt
+ * pc is the address of the instruction to return to, or of the BRK instruction
+ */
+void MOS6502::enterInterrupt(Registers &r, uint16_t pc, Interrupt type) {
+    if (type == INT_RESET) {
+        r.S -= 3;   // Fake stack pushes for RESET
+    } else {
+        if (type == INT_BRK) {  // software interrupt, BRK
+            pc += 2;    // BRK advances PC by 2
+        }
+        
+        push(r, (pc & 0xff00) >> 8);    // Push PC high
+        push(r, pc & 0xff);             // Push PC low
+        
+        uint8_t newP = getP(r);
+        if (type == INT_BRK) {  // Check for software interrupt (BRK)
+            newP |= FLAG_B;     // Set B flag
+        }
+        push(r, newP);      // Push processor flags
     }
     
-    switch (opcodeGroup) {
-        case 0x2:
-        case 0x3:   // Both bits set
-            switch (opcodeMode) {
-                case 0x0:   // #immediate
-                    if (opcodeGroup != 0x2 || opcodeInstruction != 0x0) { // Not for *KIL
-                        addressingMode = AM_IMM;
-                    }
-                    break;
-                case 0x1:   // zp
-                    addressingMode = AM_ZP;
-                    break;
-                case 0x2:   // accumulator
-                    addressingMode = AM_ACC;
-                    break;
-                case 0x3:   // abs
-                    addressingMode = AM_ABS;
-                    break;
-                case 0x5:   // zp,X
-                    if (opcodeInstruction == 0x4 || opcodeInstruction == 0x5) { // STX and LDX use zp,Y instead
-                        addressingMode = AM_ZP_Y;
-                    } else {
-                        addressingMode = AM_ZP_X;
-                    }
-                    break;
-                case 0x7:   // abs,X
-                    if (opcodeInstruction == 0x5) { // LDX uses abs,Y instead
-                        addressingMode = AM_ABS_Y;
-                    } else {
-                        addressingMode = AM_ABS_X;
-                    }
-                    break;
-            }
-            if (opcodeMode != 0x0 || opcodeInstruction == 0x5) {    // #immediate is only valid for LDX
-                switch (opcodeInstruction) {
-                    case 0x0:   // ASL
-                        if (addressingMode == AM_ACC) {
-                            if ((registers.A & 0x80) == 0x80) { // Check for carry
-                                registers.P |= FLAG_C;
-                            } else {
-                                registers.P &= ~FLAG_C;
-                            }
-                            
-                            registers.A <<= 1;  // Shift left
-                            
-                            setNZ(registers.A);
-                        } else {
-                            value16 = readPtr(addressingMode);      // Read from memory
-                            value8 = memoryMap->readByte(value16);
-                            
-                            if ((value8 & 0x80) == 0x80) {  // Check for carry
-                                registers.P |= FLAG_C;
-                            } else {
-                                registers.P &= ~FLAG_C;
-                            }
-                            
-                            value8 <<= 1;   // Shift left
-                            
-                            memoryMap->writeByte(value16, value8);  // Write back to memory
-                            
-                            setNZ(value8);
-                        }
-                        break;
-                    case 0x1:   // ROL
-                        if (addressingMode == AM_ACC) {
-                            if ((registers.A & 0x80) == 0x80) { // Check for carry
-                                boolValue = true;
-                            } else {
-                                boolValue = false;
-                            }
-                            
-                            registers.A = (registers.A << 1) | (registers.P & FLAG_C);  // Shift left with carry
-                            
-                            if ((registers.A & 0x80) == 0x80) { // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (registers.A == 0x0) {   // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        } else {
-                            value16 = readPtr(addressingMode);      // Read from memory
-                            value8 = memoryMap->readByte(value16);
-                            
-                            if ((value8 & 0x80) == 0x80) {  // Check for carry
-                                boolValue = true;
-                            } else {
-                                boolValue = false;
-                            }
-                            
-                            value8 = (value8 << 1) | (registers.P & FLAG_C);  // Shift left with carry
-                            
-                            memoryMap->writeByte(value16, value8);  // Write back to memory
-                            
-                            if ((value8 & 0x80) == 0x80) {  // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (value8 == 0x0) {  // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        }
-                        
-                        if (boolValue) {
-                            registers.P |= FLAG_C;  // Set carry
-                        } else {
-                            registers.P &= ~FLAG_C; // Clear carry
-                        }
-                        
-                        break;
-                    case 0x2:   // LSR
-                        if (addressingMode == AM_ACC) {
-                            if ((registers.A & 0x1) == 0x1) { // Check for carry
-                                registers.P |= FLAG_C;
-                            } else {
-                                registers.P &= ~FLAG_C;
-                            }
-                            
-                            registers.A >>= 1;  // Shift right
-                            
-                            if ((registers.A & 0x80) == 0x80) { // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (registers.A == 0x0) {   // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        } else {
-                            value16 = readPtr(addressingMode);      // Read from memory
-                            value8 = memoryMap->readByte(value16);
-                            
-                            if ((value8 & 0x1) == 0x1) { // Check for carry
-                                registers.P |= FLAG_C;
-                            } else {
-                                registers.P &= ~FLAG_C;
-                            }
-                            
-                            value8 >>= 1;   // Shift right
-                            
-                            memoryMap->writeByte(value16, value8);  // Write back to memory
-                            
-                            if (value8 == 0x0) {  // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        }
-                        break;
-                    case 0x3:   // ROR
-                        if (addressingMode == AM_ACC) {
-                            if ((registers.A & 0x1) == 0x1) { // Check for carry
-                                boolValue = true;
-                            } else {
-                                boolValue = false;
-                            }
-                            
-                            registers.A = (registers.A >> 1) | ((registers.P & FLAG_C) << 7);  // Shift right with carry
-                            
-                            if ((registers.A & 0x80) == 0x80) { // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (registers.A == 0x0) {   // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        } else {
-                            value16 = readPtr(addressingMode);      // Read from memory
-                            value8 = memoryMap->readByte(value16);
-                            
-                            if ((value8 & 0x1) == 0x1) { // Check for carry
-                                boolValue = true;
-                            } else {
-                                boolValue = false;
-                            }
-                            
-                            value8 = (value8 >> 1) | ((registers.P & FLAG_C) << 7); // Shift right with carry
-                            
-                            memoryMap->writeByte(value16, value8);  // Write back to memory
-                            
-                            if ((value8 & 0x80) == 0x80) {  // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (value8 == 0x0) {  // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        }
-                        
-                        if (boolValue) {
-                            registers.P |= FLAG_C;  // Set carry
-                        } else {
-                            registers.P &= ~FLAG_C; // Clear carry
-                        }
-                        
-                        break;
-                    case 0x4:   // STX, TXA or TXS
-                        if (opcodeMode == 0x2) {    // TXA
-                            registers.A = registers.X;
-                            
-                            setNZ(registers.X);
-                        } else if (opcodeMode == 0x6) { // TXS
-                            registers.S = registers.X;
-                            
-                            setNZ(registers.X);
-                        } else if (opcodeMode != 7) { // abs,X mode invalid for STX
-                            writeValue(addressingMode, registers.X);
-                        }
-                        break;
-                    case 0x5:   // LDX, TAX or TSX
-                        if (opcodeMode == 0x2) {    // TAX
-                            registers.X = registers.A;
-                            
-                            setNZ(registers.A);
-                        } else if (opcodeMode == 0x6) { // TSX
-                            registers.X = registers.S;
-                            
-                            setNZ(registers.S);
-                        } else {    // LDX
-                            registers.X = readValue(addressingMode);
-                            
-                            setNZ(registers.X);
-                        }
-                        break;
-                    case 0x6:   // DEC
-                        if (opcodeMode == 0x2) {    // DEX
-                            registers.X--;
-                            
-                            setNZ(registers.X);
-                        } else {    // DEC, accumulator mode is invalid for DEC
-                            // Get the address
-                            value16 = readPtr(addressingMode);
-                            value8 = memoryMap->readByte(value16) - 1;
-                            
-                            setNZ(value8);
-                            
-                            // Decrement the value
-                            memoryMap->writeByte(value16, value8);
-                        }
-                        break;
-                    case 0x7:   // INC
-                        if (opcodeMode == 0x2) {    // NOP
-                        } else {    // INC, accumulator mode is invalid for INC
-                            // Get the address
-                            value16 = readPtr(addressingMode);
-                            value8 = memoryMap->readByte(value16) + 1;
-                            
-                            setNZ(value8);
-                            // Increment the value
-                            memoryMap->writeByte(value16, value8);
-                        }
-                        break;
-                }
-            } else if (opcodeGroup == 0x2 && opcodeMode == 0x0) { // *KIL
-                newPC--;     // crash
-            }
-            
+    r.P |= FLAG_I;  // Set I flag
+    
+    switch (type) {
+        case INT_NONE:
+        case INT_BRK:
+        case INT_IRQ:
+            r.PC = memoryMap->readWord(0xfffe);
+            break;
+        case INT_NMI:
+            r.PC = memoryMap->readWord(0xfffa);
             break;
-        case 0x0:
-            switch (opcodeMode) {
-                case 0x0:   // #immediate
-                    if (opcodeInstruction == 0x1) { // JSR (abs) uses abs instead
-                        addressingMode = AM_ABS;
-                    } else {
-                        addressingMode = AM_IMM;
-                    }
-                    break;
-                case 0x1:   // zp
-                    addressingMode = AM_ZP;
-                    break;
-                case 0x3:   // abs
-                    addressingMode = AM_ABS;
-                    break;
-                case 0x4:   // conditional branch instruction
-                    switch (opcodeInstruction) {
-                        case 0x0:   // BPL
-                            if ((registers.P & FLAG_N) == 0x0) { // Negative clear
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x1:   // BMI
-                            if ((registers.P & FLAG_N) == FLAG_N) { // Negative set
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x2:   // BVC
-                            if ((registers.P & FLAG_V) == 0x0) { // Overflow clear
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x3:   // BVS
-                            if ((registers.P & FLAG_V) == FLAG_V) { // Overflow set
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x4:   // BCC
-                            if ((registers.P & FLAG_C) == 0x0) { // Carry clear
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x5:   // BCS
-                            if ((registers.P & FLAG_C) == FLAG_C) { // Carry set
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x6:   // BNE
-                            if ((registers.P & FLAG_Z) == 0x0) { // Zero clear
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                        case 0x7:   // BEQ
-                            if ((registers.P & FLAG_Z) == FLAG_Z) { // Zero set
-                                cycles++;
-                                value8 = memoryMap->readByte(newPC++);
-                                // Check for page boundary cross
-                                if (((newPC + static_cast<int8_t>(value8)) & 0xff00) !=
-                                    (newPC & 0xff00)) {
-                                    cycles++;
-                                }
-                                newPC += static_cast<int8_t>(value8);
-                            } else {
-                                newPC++;
-                            }
-                            
-                            break;
-                    }
-                    break;
-                case 0x5:   // zp,X
-                    addressingMode = AM_ZP_X;
-                    break;
-                case 0x7:   // abs,X
-                    addressingMode = AM_ABS_X;
-                    break;
-            }
-            if (opcodeMode != 0x4) {    // conditional branching groups into addressing mode
-                switch (opcodeInstruction) {
-                    case 0x0:   // BRK
-                        if (opcodeMode == 0x0) {    // BRK only valid with no mode
-                            if (pendingInterrupt == INT_RESET) {
-                                registers.S -= 3;   // Fake stack pushes for RESET
-                            } else {
-                                if (pendingInterrupt == INT_NONE) { // software interrupt, BRK
-                                    registers.PC += 2;  // BRK advances PC by 2
-                                }
-                                
-                                push((registers.PC & 0xff00) >> 8);     // Push PC high
-                                push(registers.PC & 0xff);              // Push PC low
-                            
-                                uint8_t newP = registers.P;
-                                if (pendingInterrupt == INT_NONE) {     // Check for software interrupt (BRK)
-                                    newP |= FLAG_B;     // Set B flag
-                                }
-                                push(newP);     // Push processor flags
-                            }
-                            
-                            registers.P |= FLAG_I;  // Set I flag
-                            
-                            switch (pendingInterrupt) {
-                                case INT_NONE:
-                                case INT_BRK:
-                                case INT_IRQ:
-                                    newPC = memoryMap->readWord(0xfffe);
-                                    break;
-                                case INT_NMI:
-                                    newPC = memoryMap->readWord(0xfffa);
-                                    break;
-                                case INT_RESET:
-                                    newPC = memoryMap->readWord(0xfffc);
-                                    break;
-                            }
-                            
-                            pendingInterrupt = INT_NONE;    // Clear the pending interrupt
-                        } else if (opcodeMode == 0x1) { // *NOP
-                        } else if (opcodeMode == 0x2) { // PHP fits this opcode
-                            push(registers.P);  // Push processor flags
-                        } else if (opcodeMode == 0x6) { // CLC
-                            registers.P &= ~FLAG_C; // Clear carry flag
-                        }
-                        break;
-                    case 0x1:   // BIT
-                        if (opcodeMode == 0x0) {    // JSR (abs) instead of BIT
-                            // Get the destination address
-                            value16 = readPtr(addressingMode);
-                            
-                            push(((registers.PC + 3) & 0xff00) >> 8);     // Push PC high
-                            push((registers.PC + 3) & 0xff);              // Push PC low
-                            
-                            newPC = value16;    // Set new address
-                        } else if (opcodeMode == 0x2) { // PLP instead of BIT
-                            registers.P = pop();    // Pop processor flags
-                        } else if (opcodeMode == 0x6) { // SEC
-                            registers.P |= FLAG_C;  // Set carry flag
-                        } else {    // BIT
-                            value8 = readValue(addressingMode);
-                            if ((value8 & FLAG_N) == FLAG_N) { // Negative set
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            if ((value8 & FLAG_V) == FLAG_V) { // Overflow set
-                                registers.P |= FLAG_V;
-                            } else {
-                                registers.P &= ~FLAG_V;
-                            }
-                            if ((value8 & registers.A) == 0) {  // Logical AND with accumulator
-                                registers.P |= FLAG_Z;  // Set zero
-                            } else {
-                                registers.P &= ~FLAG_Z; // Clear zero
-                            }
-                        }
-
-                        break;
-                    case 0x2:   // JMP
-                        if (opcodeMode == 0x0) {    // RTI instead of JMP
-                            // Get the processor flags
-                            registers.P = pop();
-                            
-                            // Get the return address
-                            value16 = pop();                                // Pop PC low
-                            value16 |= static_cast<uint16_t>(pop()) << 8;   // Pop PC high
-                            
-                            newPC = value16;    // Set new address
-                        } else if (opcodeMode == 0x2) { // PHA
-                            push(registers.A);  // Push accumulator
-                        } else if (opcodeMode == 0x6) { // CLI
-                            registers.P &= ~FLAG_I; // Clear interrupt flag
-                        } else {
-                            // Update PC to new address
-                            newPC = readPtr(addressingMode);
-                        }
-                        break;
-                    case 0x3:   // JMP (abs)
-                        if (opcodeMode == 0x0) {    // RTS instead of JMP (abs)
-                            // Get the return address
-                            value16 = pop();                                // Pop PC low
-                            value16 |= static_cast<uint16_t>(pop()) << 8;   // Pop PC high
-                            
-                            newPC = value16;    // Set new address
-                        } else if (opcodeMode == 0x2) { // PLA instead of JMP (abs)
-                            registers.A = pop();    // Pop accumulator
-                            
-                            if ((registers.A & 0x80) == 0x80) { // Check negative
-                                registers.P |= FLAG_N;
-                            } else {
-                                registers.P &= ~FLAG_N;
-                            }
-                            
-                            if (registers.A == 0x0) {   // Check zero
-                                registers.P |= FLAG_Z;
-                            } else {
-                                registers.P &= ~FLAG_Z;
-                            }
-                        } else if (opcodeMode == 0x6) { // SEI
-                            registers.P |= FLAG_I;  // Set interrupt flag
-                        } else {    // JMP (abs)
-                            // Update PC to new address
-                            newPC = memoryMap->readWord(readPtr(addressingMode));
-                            
-                            memoryMap->dumpMonitor(0x20, 2);
-                        }
-                        break;
-                    case 0x4:   // STY, TYA or DEY
-                        if (opcodeMode == 0x2) {    // DEY instead of STY
-                            registers.Y--;
-                            
-                            setNZ(registers.Y);
-                        } else if (opcodeMode == 0x6) { // TYA
-                            registers.A = registers.Y;
-                            
-                            setNZ(registers.Y);
-                        } else {
-                            writeValue(addressingMode, registers.Y);
-                        }
-                        break;
-                    case 0x5:   // LDY
-                        if (opcodeMode == 0x2) {    // TAY instead of LDY
-                            registers.Y = registers.A;
-                            
-                            setNZ(registers.A);
-                        } else if (opcodeMode == 0x6) { // CLV
-                            registers.P &= ~FLAG_V; // Clear overflow flag
-                        } else {    // LDY
-                            registers.Y = readValue(addressingMode);
-                            
-                            setNZ(registers.Y);
-                        }
-                        break;
-                    case 0x6:   // CPY, INY or CLD
-                        if (opcodeMode == 0x2) {    // INY instead of CPY
-                            registers.Y++;
-                            
-                            setNZ(registers.Y);
-                        } else if (opcodeMode == 0x6) { // CLD
-                            registers.P &= ~FLAG_D; // Clear BCD flag
-                        } else {    // CPY
-                            value8 = readValue(addressingMode);
-                            
-                            // Store result in a larger variable to determine carry
-                            svalue16 = static_cast<int8_t>(registers.Y) - static_cast<int8_t>(value8);
-                            
-                            if (svalue16 < 0)   // Check negative
-                                registers.P |= FLAG_N;
-                            else
-                                registers.P &= ~FLAG_N;
-                            
-                            if (svalue16 == 0)  // Check zero
-                                registers.P |= FLAG_Z;
-                            else
-                                registers.P &= ~FLAG_Z;
-                            
-                            if (svalue16 < value8) { // Check carry
-                                registers.P &= ~FLAG_C;
-                            } else {
-                                registers.P |= FLAG_C;
-                            }
-                        }
-                        break;
-                    case 0x7:   // CPX
-                        if (opcodeMode == 0x2) {    // INX instead of CPX
-                            registers.X++;
-                            
-                            setNZ(registers.X);
-                        } else if (opcodeMode == 0x6) { // SED
-                            registers.P |= FLAG_D;  // Set BCD flag
-                        } else {    // CPX
-                            value8 = readValue(addressingMode);
-                            
-                            // Store result in a larger variable to determine carry
-                            svalue16 = static_cast<int8_t>(registers.X) - static_cast<int8_t>(value8);
-                            
-                            setNZ(svalue16);
-                            
-                            /* if ((svalue16 & 0x100) == 0) {  // Check carry
-                             registers.P &= ~FLAG_C;
-                             } else {
-                             registers.P |= FLAG_C;
-                             } */
-                            
-                            if (registers.A < value8) { // Check carry
-                                registers.P &= ~FLAG_C;
-                            } else {
-                                registers.P |= FLAG_C;
-                            }
-                        }
-                        break;
-                }
-            }
+        case INT_RESET:
+            r.PC = memoryMap->readWord(0xfffc);
             break;
     }
+}
+
+/**
+ * JSR: Jump to new location saving return address
+ */
+void MOS6502::opJSR(Registers &r) {
+    // Get the destination address
+    uint16_t value16 = readPtr<AM_ABS>(r);
     
-    // Apply changes to PC
-    registers.PC = newPC;
+    push(r, (r.PC & 0xff00) >> 8);  // Push PC high
+    push(r, r.PC & 0xff);           // Push PC low
     
-    // CPU timing
-    high_resolution_clock::time_point end_time = high_resolution_clock::now();
-    nanoseconds exec_time = duration_cast<nanoseconds>(end_time - start_time);
+    r.PC = value16;     // Set new address
+}
+
+/**
+ * RTI: Return from interrupt
+ */
+void MOS6502::opRTI(Registers &r) {
+    // Get the processor flags
+    setP(r, pop(r));
+    checkPendingIRQ(r);
     
-    // CPU takes 1000 nanoseconds per cycle
+    // Get the return address
+    uint16_t value16 = pop(r);                          // Pop PC low
+    value16 |= static_cast<uint16_t>(pop(r)) << 8;      // Pop PC high
+    
+    r.PC = value16;     // Set new address
+}
 
-    high_resolution_clock::time_point goal_time = start_time + nanoseconds(cycles * 1000);
-    while (start_time + exec_time < goal_time) {
-        //this_thread::sleep_for(nanoseconds(1000));    // Usually sleeps way too long
-        exec_time = duration_cast<nanoseconds>(high_resolution_clock::now() - start_time);
+/**
+ * RTS: Return from subroutine
+ */
+void MOS6502::opRTS(Registers &r) {
+    // Get the return address
+    uint16_t value16 = pop(r);                          // Pop PC low
+    value16 |= static_cast<uint16_t>(pop(r)) << 8;      // Pop PC high
+    
+    r.PC = value16;     // Set new address
+}
+
+/**
+ * PHP: Push processor flags on stack
+ */
+void MOS6502::opPHP(Registers &r) {
+    push(r, getP(r));
+}
+
+/**
+ * PLP: Pull processor flags from stack
+ */
+void MOS6502::opPLP(Registers &r) {
+    setP(r, pop(r));
+    checkPendingIRQ(r);
+}
+
+/**
+ * PHA: Push accumulator on stack
+ */
+void MOS6502::opPHA(Registers &r) {
+    push(r, r.A);
+}
+
+/**
+ * PLA: Pull accumulator from stack
+ */
+void MOS6502::opPLA(Registers &r) {
+    r.A = pop(r);
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * CLC: Clear carry flag
+ */
+void MOS6502::opCLC(Registers &r) {
+    r.carry = 0;
+}
+
+/**
+ * SEC: Set carry flag
+ */
+void MOS6502::opSEC(Registers &r) {
+    r.carry = 1;
+}
+
+/**
+ * CLI: Clear interrupt flag
+ */
+void MOS6502::opCLI(Registers &r) {
+    r.P &= ~FLAG_I;
+    checkPendingIRQ(r);
+}
+
+/**
+ * SEI: Set interrupt flag
+ */
+void MOS6502::opSEI(Registers &r) {
+    r.P |= FLAG_I;
+}
+
+/**
+ * CLV: Clear overflow flag
+ */
+void MOS6502::opCLV(Registers &r) {
+    r.overflow = 0;
+}
+
+/**
+ * CLD: Clear BCD flag
+ */
+void MOS6502::opCLD(Registers &r) {
+    r.P &= ~FLAG_D;
+}
+
+/**
+ * SED: Set BCD flag
+ */
+void MOS6502::opSED(Registers &r) {
+    r.P |= FLAG_D;
+}
+
+/**
+ * TXA: Transfer index X to accumulator
+ */
+void MOS6502::opTXA(Registers &r) {
+    r.A = r.X;
+    
+    setNZ(r, r.X);
+}
+
+/**
+ * TXS: Transfer index X to stack pointer
+ */
+void MOS6502::opTXS(Registers &r) {
+    r.S = r.X;
+    
+    setNZ(r, r.X);
+}
+
+/**
+ * TAX: Transfer accumulator to index X
+ */
+void MOS6502::opTAX(Registers &r) {
+    r.X = r.A;
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * TSX: Transfer stack pointer to index X
+ */
+void MOS6502::opTSX(Registers &r) {
+    r.X = r.S;
+    
+    setNZ(r, r.S);
+}
+
+/**
+ * TYA: Transfer index Y to accumulator
+ */
+void MOS6502::opTYA(Registers &r) {
+    r.A = r.Y;
+    
+    setNZ(r, r.Y);
+}
+
+/**
+ * TAY: Transfer accumulator to index Y
+ */
+void MOS6502::opTAY(Registers &r) {
+    r.Y = r.A;
+    
+    setNZ(r, r.A);
+}
+
+/**
+ * DEX: Decrement index X by one
+ */
+void MOS6502::opDEX(Registers &r) {
+    r.X--;
+    
+    setNZ(r, r.X);
+}
+
+/**
+ * DEY: Decrement index Y by one
+ */
+void MOS6502::opDEY(Registers &r) {
+    r.Y--;
+    
+    setNZ(r, r.Y);
+}
+
+/**
+ * INX: Increment index X by one
+ */
+void MOS6502::opINX(Registers &r) {
+    r.X++;
+    
+    setNZ(r, r.X);
+}
+
+/**
+ * INY: Increment index Y by one
+ */
+void MOS6502::opINY(Registers &r) {
+    r.Y++;
+    
+    setNZ(r, r.Y);
+}
+
+/**
+ * NOP: No operation
+ */
+void MOS6502::opNOP(Registers &) {
+}
+
+/**
+ * *KIL: Halts the CPU by executing the same opcode forever
+ */
+void MOS6502::opKIL(Registers &r) {
+    r.PC--;     // crash
+}
+
+/**
+ * Returns the number of cycles consumed by a particular opcode.
+ * Cycle counts are stored in an array for easy lookup.
+ */
+inline uint_fast8_t MOS6502::getCycles(uint8_t opcode) {
+    static const uint_fast8_t cycleMap[] = {7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, 3, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2,
+        7, 4, 4, 7, 7, 6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 6, 6,
+        2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, 3, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 6, 6, 2, 8, 3, 3, 5, 5, 4,
+        2, 2, 2, 5, 4, 6, 6, 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+        3, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, 2, 5, 2, 5, 4, 4, 4,
+        4, 2, 4, 2, 4, 4, 4, 4, 4, 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, 3, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4,
+        7, 7, 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7};
+    
+    return cycleMap[opcode];
+}
+
+/**
+ * Returns the length in bytes of a particular opcode, as decoded before its handler runs.
+ * Opcodes running two operations are given the length of the first.
+ */
+inline uint_fast8_t MOS6502::getLength(uint8_t opcode) {
+    static const uint_fast8_t lengthMap[] = {1, 2, 1, 2, 1, 2, 2, 2, 1, 2, 1, 2, 1, 3, 3, 3, 2, 2, 2, 2, 1, 2, 2, 2, 1, 3, 2,
+        3, 1, 3, 3, 3, 3, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 3, 2, 3, 3, 3, 3, 3, 1, 2,
+        1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 3, 2, 3, 3, 3, 3, 3, 1, 2, 1, 2, 2, 2, 2, 2, 1,
+        2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 3, 2, 3, 3, 3, 3, 3, 1, 2, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 3, 3, 3, 3,
+        2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 1, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2,
+        2, 1, 3, 1, 3, 3, 3, 3, 3, 2, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 3, 2, 3, 3, 3,
+        3, 3, 2, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 3, 2, 3, 3, 3, 3, 3};
+    
+    return lengthMap[opcode];
+}
+
+/**
+ * Returns the instruction at an address, decoding it on first use.
+ * Instructions read from I/O space are decoded every time, since reading them may have side effects.
+ * Watched instructions are too, and are reported to the memory map when they are about to be executed.
+ */
+const MOS6502::DecodedInstruction &MOS6502::decode(uint16_t pc, bool executing) {
+    DecodedInstruction &cached = decodeCache[pc];
+    if (cached.length != 0) {
+        return cached;
+    }
+    
+    DecodedInstruction decoded;
+    decoded.opcode = memoryMap->readByte(pc);
+    decoded.length = getLength(decoded.opcode);
+    decoded.cycles = getCycles(decoded.opcode);
+    
+    bool cacheable = memoryMap->isCacheable(pc);
+    if (decoded.length == 3) {
+        decoded.operand = memoryMap->readWord(static_cast<uint16_t>(pc + 1));
+        cacheable = cacheable && memoryMap->isCacheable(pc + 1) && memoryMap->isCacheable(pc + 2);
+    } else if (decoded.length == 2) {
+        decoded.operand = memoryMap->readByte(static_cast<uint16_t>(pc + 1));
+        cacheable = cacheable && memoryMap->isCacheable(pc + 1);
+    } else {
+        decoded.operand = 0;
+    }
+    
+    if (!cacheable) {
+        if (executing)
+            memoryMap->watchExecute(pc, decoded.opcode);
+        
+        uncached = decoded;
+        return uncached;
+    }
+    
+    // Have writes to any of its bytes drop the instruction
+    for (uint_fast8_t i = 0; i < decoded.length; i++) {
+        memoryMap->markCode(pc + i);
+    }
+    
+    cached = decoded;
+    return cached;
+}
+
+/**
+ * Drops the decoded instructions that include a byte that was written
+ */
+void MOS6502::invalidate(uint16_t address) {
+    // Instructions are up to 3 bytes long, so may start up to 2 bytes before
+    decodeCache[address].length = 0;
+    decodeCache[static_cast<uint16_t>(address - 1)].length = 0;
+    decodeCache[static_cast<uint16_t>(address - 2)].length = 0;
+}
+
+/**
+ * Checks whether a short backward branch closes an idle loop, ending the slice if it does.
+ * An iteration that leaves the registers as it found them, in a loop that only reads,
+ * repeats until a device changes state or an interrupt arrives.
+ */
+void MOS6502::checkIdleLoop(Registers &r, uint_fast32_t cycles, uint16_t branch) {
+    if (idleLoop.valid && r.PC == idleLoop.state.PC && r.A == idleLoop.state.A && r.X == idleLoop.state.X &&
+        r.Y == idleLoop.state.Y && r.S == idleLoop.state.S && getP(r) == getP(idleLoop.state) &&
+        !isInterruptPending(r) && isIdleLoop(r.PC, branch)) {
+        idlePeriod = cycles - idleLoop.cycles;
+        sliceBudget.store(0, memory_order_relaxed);     // Let the CPU thread park
+    }
+    
+    idleLoop.valid = true;
+    idleLoop.state = r;
+    idleLoop.cycles = cycles;
+}
+
+/**
+ * Returns whether the code from start up to the branch only reads memory and sets registers.
+ * Other branches and jumps are not allowed, so every iteration runs the same instructions.
+ */
+bool MOS6502::isIdleLoop(uint16_t start, uint16_t branch) {
+    uint16_t address = start;
+    
+    while (address != branch) {
+        switch (memoryMap->readByte(address)) {
+            case 0xea:  // NOP
+            case 0x18: case 0x38: case 0xb8: case 0xd8: case 0xf8:  // CLC, SEC, CLV, CLD, SED
+            case 0x8a: case 0x98: case 0xaa: case 0xa8: case 0xba:  // TXA, TYA, TAX, TAY, TSX
+                address += 1;
+                break;
+            case 0xa9: case 0xa5: case 0xb5: case 0xa1: case 0xb1:  // LDA
+            case 0xa2: case 0xa6: case 0xb6:                        // LDX
+            case 0xa0: case 0xa4: case 0xb4:                        // LDY
+            case 0x24:                                              // BIT
+            case 0xc9: case 0xc5: case 0xd5: case 0xc1: case 0xd1:  // CMP
+            case 0xe0: case 0xe4: case 0xc0: case 0xc4:             // CPX, CPY
+            case 0x29: case 0x25: case 0x35: case 0x21: case 0x31:  // AND
+            case 0x09: case 0x05: case 0x15: case 0x01: case 0x11:  // ORA
+            case 0x49: case 0x45: case 0x55: case 0x41: case 0x51:  // EOR
+                address += 2;
+                break;
+            case 0xad: case 0xbd: case 0xb9:                        // LDA
+            case 0xae: case 0xbe: case 0xac: case 0xbc:             // LDX, LDY
+            case 0x2c:                                              // BIT
+            case 0xcd: case 0xdd: case 0xd9: case 0xec: case 0xcc:  // CMP, CPX, CPY
+            case 0x2d: case 0x3d: case 0x39:                        // AND
+            case 0x0d: case 0x1d: case 0x19:                        // ORA
+            case 0x4d: case 0x5d: case 0x59:                        // EOR
+                address += 3;
+                break;
+            default:    // Writes memory, changes flow or touches the stack
+                return false;
+        }
+        
+        // Stepped over the branch, so the bytes are not the code being run
+        if (static_cast<uint16_t>(branch - address) > MAX_IDLE_LOOP) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Opcode dispatch table.
+ * Maps every opcode to the handler(s) implementing it, with the addressing mode
+ * resolved at compile time. Undocumented opcodes with both low bits set run the
+ * group 1 and group 2 operations they decode to, one after the other, the second
+ * fetching an operand of its own.
+ */
+#define MOS6502_OPCODES(OPCODE) \
+    OPCODE(0x00, opBRK(r, pc))                                                               \
+    OPCODE(0x01, opORA<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x02, opKIL(r))                                                                   \
+    OPCODE(0x03, opORA<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x04, opNOP(r))                                                                   \
+    OPCODE(0x05, opORA<AM_ZP>(r))                                                            \
+    OPCODE(0x06, opASL<AM_ZP>(r))                                                            \
+    OPCODE(0x07, opORA<AM_ZP>(r); fetchOperand<AM_ZP>(r); opASL<AM_ZP>(r))                   \
+    OPCODE(0x08, opPHP(r))                                                                   \
+    OPCODE(0x09, opORA<AM_IMM>(r))                                                           \
+    OPCODE(0x0a, opASL<AM_ACC>(r))                                                           \
+    OPCODE(0x0b, opORA<AM_IMM>(r); opASL<AM_ACC>(r))                                         \
+    OPCODE(0x0c, opNOP(r))                                                                   \
+    OPCODE(0x0d, opORA<AM_ABS>(r))                                                           \
+    OPCODE(0x0e, opASL<AM_ABS>(r))                                                           \
+    OPCODE(0x0f, opORA<AM_ABS>(r); fetchOperand<AM_ABS>(r); opASL<AM_ABS>(r))                \
+    OPCODE(0x10, (opBranch<FLAG_N, false>(r, cycles)))                                       \
+    OPCODE(0x11, opORA<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0x12, opASL<AM_IMM>(r))                                                           \
+    OPCODE(0x13, opORA<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opASL<AM_ZP_IND_Y>(r)) \
+    OPCODE(0x14, opNOP(r))                                                                   \
+    OPCODE(0x15, opORA<AM_ZP_X>(r))                                                          \
+    OPCODE(0x16, opASL<AM_ZP_X>(r))                                                          \
+    OPCODE(0x17, opORA<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opASL<AM_ZP_X>(r))             \
+    OPCODE(0x18, opCLC(r))                                                                   \
+    OPCODE(0x19, opORA<AM_ABS_Y>(r))                                                         \
+    OPCODE(0x1a, opASL<AM_IMM>(r))                                                           \
+    OPCODE(0x1b, opORA<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opASL<AM_ABS_Y>(r))          \
+    OPCODE(0x1c, opNOP(r))                                                                   \
+    OPCODE(0x1d, opORA<AM_ABS_X>(r))                                                         \
+    OPCODE(0x1e, opASL<AM_ABS_X>(r))                                                         \
+    OPCODE(0x1f, opORA<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opASL<AM_ABS_X>(r))          \
+    OPCODE(0x20, opJSR(r))                                                                   \
+    OPCODE(0x21, opAND<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x22, opKIL(r))                                                                   \
+    OPCODE(0x23, opAND<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x24, opBIT<AM_ZP>(r))                                                            \
+    OPCODE(0x25, opAND<AM_ZP>(r))                                                            \
+    OPCODE(0x26, opROL<AM_ZP>(r))                                                            \
+    OPCODE(0x27, opAND<AM_ZP>(r); fetchOperand<AM_ZP>(r); opROL<AM_ZP>(r))                   \
+    OPCODE(0x28, opPLP(r))                                                                   \
+    OPCODE(0x29, opAND<AM_IMM>(r))                                                           \
+    OPCODE(0x2a, opROL<AM_ACC>(r))                                                           \
+    OPCODE(0x2b, opAND<AM_IMM>(r); opROL<AM_ACC>(r))                                         \
+    OPCODE(0x2c, opBIT<AM_ABS>(r))                                                           \
+    OPCODE(0x2d, opAND<AM_ABS>(r))                                                           \
+    OPCODE(0x2e, opROL<AM_ABS>(r))                                                           \
+    OPCODE(0x2f, opAND<AM_ABS>(r); fetchOperand<AM_ABS>(r); opROL<AM_ABS>(r))                \
+    OPCODE(0x30, (opBranch<FLAG_N, true>(r, cycles)))                                        \
+    OPCODE(0x31, opAND<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0x32, opROL<AM_IMM>(r))                                                           \
+    OPCODE(0x33, opAND<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opROL<AM_ZP_IND_Y>(r)) \
+    OPCODE(0x34, opBIT<AM_ZP_X>(r))                                                          \
+    OPCODE(0x35, opAND<AM_ZP_X>(r))                                                          \
+    OPCODE(0x36, opROL<AM_ZP_X>(r))                                                          \
+    OPCODE(0x37, opAND<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opROL<AM_ZP_X>(r))             \
+    OPCODE(0x38, opSEC(r))                                                                   \
+    OPCODE(0x39, opAND<AM_ABS_Y>(r))                                                         \
+    OPCODE(0x3a, opROL<AM_IMM>(r))                                                           \
+    OPCODE(0x3b, opAND<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opROL<AM_ABS_Y>(r))          \
+    OPCODE(0x3c, opBIT<AM_ABS_X>(r))                                                         \
+    OPCODE(0x3d, opAND<AM_ABS_X>(r))                                                         \
+    OPCODE(0x3e, opROL<AM_ABS_X>(r))                                                         \
+    OPCODE(0x3f, opAND<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opROL<AM_ABS_X>(r))          \
+    OPCODE(0x40, opRTI(r))                                                                   \
+    OPCODE(0x41, opEOR<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x42, opKIL(r))                                                                   \
+    OPCODE(0x43, opEOR<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x44, opJMP<AM_ZP>(r))                                                            \
+    OPCODE(0x45, opEOR<AM_ZP>(r))                                                            \
+    OPCODE(0x46, opLSR<AM_ZP>(r))                                                            \
+    OPCODE(0x47, opEOR<AM_ZP>(r); fetchOperand<AM_ZP>(r); opLSR<AM_ZP>(r))                   \
+    OPCODE(0x48, opPHA(r))                                                                   \
+    OPCODE(0x49, opEOR<AM_IMM>(r))                                                           \
+    OPCODE(0x4a, opLSR<AM_ACC>(r))                                                           \
+    OPCODE(0x4b, opEOR<AM_IMM>(r); opLSR<AM_ACC>(r))                                         \
+    OPCODE(0x4c, opJMP<AM_ABS>(r))                                                           \
+    OPCODE(0x4d, opEOR<AM_ABS>(r))                                                           \
+    OPCODE(0x4e, opLSR<AM_ABS>(r))                                                           \
+    OPCODE(0x4f, opEOR<AM_ABS>(r); fetchOperand<AM_ABS>(r); opLSR<AM_ABS>(r))                \
+    OPCODE(0x50, (opBranch<FLAG_V, false>(r, cycles)))                                       \
+    OPCODE(0x51, opEOR<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0x52, opLSR<AM_IMM>(r))                                                           \
+    OPCODE(0x53, opEOR<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opLSR<AM_ZP_IND_Y>(r)) \
+    OPCODE(0x54, opJMP<AM_ZP_X>(r))                                                          \
+    OPCODE(0x55, opEOR<AM_ZP_X>(r))                                                          \
+    OPCODE(0x56, opLSR<AM_ZP_X>(r))                                                          \
+    OPCODE(0x57, opEOR<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opLSR<AM_ZP_X>(r))             \
+    OPCODE(0x58, opCLI(r))                                                                   \
+    OPCODE(0x59, opEOR<AM_ABS_Y>(r))                                                         \
+    OPCODE(0x5a, opLSR<AM_IMM>(r))                                                           \
+    OPCODE(0x5b, opEOR<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opLSR<AM_ABS_Y>(r))          \
+    OPCODE(0x5c, opJMP<AM_ABS_X>(r))                                                         \
+    OPCODE(0x5d, opEOR<AM_ABS_X>(r))                                                         \
+    OPCODE(0x5e, opLSR<AM_ABS_X>(r))                                                         \
+    OPCODE(0x5f, opEOR<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opLSR<AM_ABS_X>(r))          \
+    OPCODE(0x60, opRTS(r))                                                                   \
+    OPCODE(0x61, opADC<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x62, opKIL(r))                                                                   \
+    OPCODE(0x63, opADC<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x64, opJMPIndirect<AM_ZP>(r))                                                    \
+    OPCODE(0x65, opADC<AM_ZP>(r))                                                            \
+    OPCODE(0x66, opROR<AM_ZP>(r))                                                            \
+    OPCODE(0x67, opADC<AM_ZP>(r); fetchOperand<AM_ZP>(r); opROR<AM_ZP>(r))                   \
+    OPCODE(0x68, opPLA(r))                                                                   \
+    OPCODE(0x69, opADC<AM_IMM>(r))                                                           \
+    OPCODE(0x6a, opROR<AM_ACC>(r))                                                           \
+    OPCODE(0x6b, opADC<AM_IMM>(r); opROR<AM_ACC>(r))                                         \
+    OPCODE(0x6c, opJMPIndirect<AM_ABS>(r))                                                   \
+    OPCODE(0x6d, opADC<AM_ABS>(r))                                                           \
+    OPCODE(0x6e, opROR<AM_ABS>(r))                                                           \
+    OPCODE(0x6f, opADC<AM_ABS>(r); fetchOperand<AM_ABS>(r); opROR<AM_ABS>(r))                \
+    OPCODE(0x70, (opBranch<FLAG_V, true>(r, cycles)))                                        \
+    OPCODE(0x71, opADC<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0x72, opROR<AM_IMM>(r))                                                           \
+    OPCODE(0x73, opADC<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opROR<AM_ZP_IND_Y>(r)) \
+    OPCODE(0x74, opJMPIndirect<AM_ZP_X>(r))                                                  \
+    OPCODE(0x75, opADC<AM_ZP_X>(r))                                                          \
+    OPCODE(0x76, opROR<AM_ZP_X>(r))                                                          \
+    OPCODE(0x77, opADC<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opROR<AM_ZP_X>(r))             \
+    OPCODE(0x78, opSEI(r))                                                                   \
+    OPCODE(0x79, opADC<AM_ABS_Y>(r))                                                         \
+    OPCODE(0x7a, opROR<AM_IMM>(r))                                                           \
+    OPCODE(0x7b, opADC<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opROR<AM_ABS_Y>(r))          \
+    OPCODE(0x7c, opJMPIndirect<AM_ABS_X>(r))                                                 \
+    OPCODE(0x7d, opADC<AM_ABS_X>(r))                                                         \
+    OPCODE(0x7e, opROR<AM_ABS_X>(r))                                                         \
+    OPCODE(0x7f, opADC<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opROR<AM_ABS_X>(r))          \
+    OPCODE(0x80, opNOP(r))                                                                   \
+    OPCODE(0x81, opSTA<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x82, opKIL(r))                                                                   \
+    OPCODE(0x83, opSTA<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0x84, opSTY<AM_ZP>(r))                                                            \
+    OPCODE(0x85, opSTA<AM_ZP>(r))                                                            \
+    OPCODE(0x86, opSTX<AM_ZP>(r))                                                            \
+    OPCODE(0x87, opSTA<AM_ZP>(r); fetchOperand<AM_ZP>(r); opSTX<AM_ZP>(r))                   \
+    OPCODE(0x88, opDEY(r))                                                                   \
+    OPCODE(0x89, opNOP(r))                                                                   \
+    OPCODE(0x8a, opTXA(r))                                                                   \
+    OPCODE(0x8b, opTXA(r))                                                                   \
+    OPCODE(0x8c, opSTY<AM_ABS>(r))                                                           \
+    OPCODE(0x8d, opSTA<AM_ABS>(r))                                                           \
+    OPCODE(0x8e, opSTX<AM_ABS>(r))                                                           \
+    OPCODE(0x8f, opSTA<AM_ABS>(r); fetchOperand<AM_ABS>(r); opSTX<AM_ABS>(r))                \
+    OPCODE(0x90, (opBranch<FLAG_C, false>(r, cycles)))                                       \
+    OPCODE(0x91, opSTA<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0x92, opNOP(r))                                                                   \
+    OPCODE(0x93, opSTA<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opSTX<AM_ZP_IND_Y>(r)) \
+    OPCODE(0x94, opSTY<AM_ZP_X>(r))                                                          \
+    OPCODE(0x95, opSTA<AM_ZP_X>(r))                                                          \
+    OPCODE(0x96, opSTX<AM_ZP_Y>(r))                                                          \
+    OPCODE(0x97, opSTA<AM_ZP_X>(r); fetchOperand<AM_ZP_Y>(r); opSTX<AM_ZP_Y>(r))             \
+    OPCODE(0x98, opTYA(r))                                                                   \
+    OPCODE(0x99, opSTA<AM_ABS_Y>(r))                                                         \
+    OPCODE(0x9a, opTXS(r))                                                                   \
+    OPCODE(0x9b, opSTA<AM_ABS_Y>(r); opTXS(r))                                               \
+    OPCODE(0x9c, opSTY<AM_ABS_X>(r))                                                         \
+    OPCODE(0x9d, opSTA<AM_ABS_X>(r))                                                         \
+    OPCODE(0x9e, opNOP(r))                                                                   \
+    OPCODE(0x9f, opSTA<AM_ABS_X>(r))                                                         \
+    OPCODE(0xa0, opLDY<AM_IMM>(r))                                                           \
+    OPCODE(0xa1, opLDA<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0xa2, opLDX<AM_IMM>(r))                                                           \
+    OPCODE(0xa3, opLDA<AM_ZP_X_IND>(r); fetchOperand<AM_IMM>(r); opLDX<AM_IMM>(r))           \
+    OPCODE(0xa4, opLDY<AM_ZP>(r))                                                            \
+    OPCODE(0xa5, opLDA<AM_ZP>(r))                                                            \
+    OPCODE(0xa6, opLDX<AM_ZP>(r))                                                            \
+    OPCODE(0xa7, opLDA<AM_ZP>(r); fetchOperand<AM_ZP>(r); opLDX<AM_ZP>(r))                   \
+    OPCODE(0xa8, opTAY(r))                                                                   \
+    OPCODE(0xa9, opLDA<AM_IMM>(r))                                                           \
+    OPCODE(0xaa, opTAX(r))                                                                   \
+    OPCODE(0xab, opLDA<AM_IMM>(r); opTAX(r))                                                 \
+    OPCODE(0xac, opLDY<AM_ABS>(r))                                                           \
+    OPCODE(0xad, opLDA<AM_ABS>(r))                                                           \
+    OPCODE(0xae, opLDX<AM_ABS>(r))                                                           \
+    OPCODE(0xaf, opLDA<AM_ABS>(r); fetchOperand<AM_ABS>(r); opLDX<AM_ABS>(r))                \
+    OPCODE(0xb0, (opBranch<FLAG_C, true>(r, cycles)))                                        \
+    OPCODE(0xb1, opLDA<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0xb2, opLDX<AM_IMM>(r))                                                           \
+    OPCODE(0xb3, opLDA<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opLDX<AM_ZP_IND_Y>(r)) \
+    OPCODE(0xb4, opLDY<AM_ZP_X>(r))                                                          \
+    OPCODE(0xb5, opLDA<AM_ZP_X>(r))                                                          \
+    OPCODE(0xb6, opLDX<AM_ZP_Y>(r))                                                          \
+    OPCODE(0xb7, opLDA<AM_ZP_X>(r); fetchOperand<AM_ZP_Y>(r); opLDX<AM_ZP_Y>(r))             \
+    OPCODE(0xb8, opCLV(r))                                                                   \
+    OPCODE(0xb9, opLDA<AM_ABS_Y>(r))                                                         \
+    OPCODE(0xba, opTSX(r))                                                                   \
+    OPCODE(0xbb, opLDA<AM_ABS_Y>(r); opTSX(r))                                               \
+    OPCODE(0xbc, opLDY<AM_ABS_X>(r))                                                         \
+    OPCODE(0xbd, opLDA<AM_ABS_X>(r))                                                         \
+    OPCODE(0xbe, opLDX<AM_ABS_Y>(r))                                                         \
+    OPCODE(0xbf, opLDA<AM_ABS_X>(r); fetchOperand<AM_ABS_Y>(r); opLDX<AM_ABS_Y>(r))          \
+    OPCODE(0xc0, opCPY<AM_IMM>(r))                                                           \
+    OPCODE(0xc1, opCMP<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0xc2, opKIL(r))                                                                   \
+    OPCODE(0xc3, opCMP<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0xc4, opCPY<AM_ZP>(r))                                                            \
+    OPCODE(0xc5, opCMP<AM_ZP>(r))                                                            \
+    OPCODE(0xc6, opDEC<AM_ZP>(r))                                                            \
+    OPCODE(0xc7, opCMP<AM_ZP>(r); fetchOperand<AM_ZP>(r); opDEC<AM_ZP>(r))                   \
+    OPCODE(0xc8, opINY(r))                                                                   \
+    OPCODE(0xc9, opCMP<AM_IMM>(r))                                                           \
+    OPCODE(0xca, opDEX(r))                                                                   \
+    OPCODE(0xcb, opCMP<AM_IMM>(r); opDEX(r))                                                 \
+    OPCODE(0xcc, opCPY<AM_ABS>(r))                                                           \
+    OPCODE(0xcd, opCMP<AM_ABS>(r))                                                           \
+    OPCODE(0xce, opDEC<AM_ABS>(r))                                                           \
+    OPCODE(0xcf, opCMP<AM_ABS>(r); fetchOperand<AM_ABS>(r); opDEC<AM_ABS>(r))                \
+    OPCODE(0xd0, (opBranch<FLAG_Z, false>(r, cycles)))                                       \
+    OPCODE(0xd1, opCMP<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0xd2, opDEC<AM_IMM>(r))                                                           \
+    OPCODE(0xd3, opCMP<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opDEC<AM_ZP_IND_Y>(r)) \
+    OPCODE(0xd4, opCPY<AM_ZP_X>(r))                                                          \
+    OPCODE(0xd5, opCMP<AM_ZP_X>(r))                                                          \
+    OPCODE(0xd6, opDEC<AM_ZP_X>(r))                                                          \
+    OPCODE(0xd7, opCMP<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opDEC<AM_ZP_X>(r))             \
+    OPCODE(0xd8, opCLD(r))                                                                   \
+    OPCODE(0xd9, opCMP<AM_ABS_Y>(r))                                                         \
+    OPCODE(0xda, opDEC<AM_IMM>(r))                                                           \
+    OPCODE(0xdb, opCMP<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opDEC<AM_ABS_Y>(r))          \
+    OPCODE(0xdc, opCPY<AM_ABS_X>(r))                                                         \
+    OPCODE(0xdd, opCMP<AM_ABS_X>(r))                                                         \
+    OPCODE(0xde, opDEC<AM_ABS_X>(r))                                                         \
+    OPCODE(0xdf, opCMP<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opDEC<AM_ABS_X>(r))          \
+    OPCODE(0xe0, opCPX<AM_IMM>(r))                                                           \
+    OPCODE(0xe1, opSBC<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0xe2, opKIL(r))                                                                   \
+    OPCODE(0xe3, opSBC<AM_ZP_X_IND>(r))                                                      \
+    OPCODE(0xe4, opCPX<AM_ZP>(r))                                                            \
+    OPCODE(0xe5, opSBC<AM_ZP>(r))                                                            \
+    OPCODE(0xe6, opINC<AM_ZP>(r))                                                            \
+    OPCODE(0xe7, opSBC<AM_ZP>(r); fetchOperand<AM_ZP>(r); opINC<AM_ZP>(r))                   \
+    OPCODE(0xe8, opINX(r))                                                                   \
+    OPCODE(0xe9, opSBC<AM_IMM>(r))                                                           \
+    OPCODE(0xea, opNOP(r))                                                                   \
+    OPCODE(0xeb, opSBC<AM_IMM>(r))                                                           \
+    OPCODE(0xec, opCPX<AM_ABS>(r))                                                           \
+    OPCODE(0xed, opSBC<AM_ABS>(r))                                                           \
+    OPCODE(0xee, opINC<AM_ABS>(r))                                                           \
+    OPCODE(0xef, opSBC<AM_ABS>(r); fetchOperand<AM_ABS>(r); opINC<AM_ABS>(r))                \
+    OPCODE(0xf0, (opBranch<FLAG_Z, true>(r, cycles)))                                        \
+    OPCODE(0xf1, opSBC<AM_ZP_IND_Y>(r))                                                      \
+    OPCODE(0xf2, opINC<AM_IMM>(r))                                                           \
+    OPCODE(0xf3, opSBC<AM_ZP_IND_Y>(r); fetchOperand<AM_ZP_IND_Y>(r); opINC<AM_ZP_IND_Y>(r)) \
+    OPCODE(0xf4, opCPX<AM_ZP_X>(r))                                                          \
+    OPCODE(0xf5, opSBC<AM_ZP_X>(r))                                                          \
+    OPCODE(0xf6, opINC<AM_ZP_X>(r))                                                          \
+    OPCODE(0xf7, opSBC<AM_ZP_X>(r); fetchOperand<AM_ZP_X>(r); opINC<AM_ZP_X>(r))             \
+    OPCODE(0xf8, opSED(r))                                                                   \
+    OPCODE(0xf9, opSBC<AM_ABS_Y>(r))                                                         \
+    OPCODE(0xfa, opINC<AM_IMM>(r))                                                           \
+    OPCODE(0xfb, opSBC<AM_ABS_Y>(r); fetchOperand<AM_ABS_Y>(r); opINC<AM_ABS_Y>(r))          \
+    OPCODE(0xfc, opCPX<AM_ABS_X>(r))                                                         \
+    OPCODE(0xfd, opSBC<AM_ABS_X>(r))                                                         \
+    OPCODE(0xfe, opINC<AM_ABS_X>(r))                                                         \
+    OPCODE(0xff, opSBC<AM_ABS_X>(r); fetchOperand<AM_ABS_X>(r); opINC<AM_ABS_X>(r))
+
+#if defined(__GNUC__)
+#define MOS6502_COMPUTED_GOTO   // Labels as values are supported by GCC and Clang
+#endif
+
+#define OPCODE_FUNCTION(opcode, handler) \
+template<> void MOS6502::runOpcode<opcode>(Registers &r, uint_fast32_t &cycles, uint16_t pc) { \
+    (void)r; (void)cycles; (void)pc;    /* Not every handler uses them */ \
+    handler; \
+}
+MOS6502_OPCODES(OPCODE_FUNCTION)
+#undef OPCODE_FUNCTION
+
+/**
+ * Runs an opcode with the given operand, for use through a function pointer
+ */
+template<uint8_t opcode>
+void MOS6502::callOpcode(MOS6502 *cpu, Registers &r, uint_fast32_t &cycles, uint16_t pc, uint16_t operand) {
+    cpu->operand = operand;
+    cpu->runOpcode<opcode>(r, cycles, pc);
+}
+
+#define OPCODE_POINTER(opcode, handler) &MOS6502::callOpcode<opcode>,
+const MOS6502::OpcodeFunction MOS6502::opcodeFunctions[256] = { MOS6502_OPCODES(OPCODE_POINTER) };
+#undef OPCODE_POINTER
+
+/**
+ * Prepares for a slice of cycleBudget cycles, servicing any pending interrupt
+ */
+void MOS6502::startSlice(Registers &r, uint_fast32_t &cycles, uint_fast32_t cycleBudget) {
+    sliceBudget.store(cycleBudget, memory_order_relaxed);
+    sliceCounter = &cycles;     // Lets devices read the time during the slice
+    idlePeriod = 0;
+    idleLoop.valid = false;     // Cycle counts restart with the slice
+    
+    // Check for an interrupt, ignoring IRQ if interrupt flag is set
+    if (isInterruptPending(r)) {
+        uint_fast8_t lines = interruptLines.load(memory_order_relaxed);
+        Interrupt type = (lines & INT_RESET) ? INT_RESET : (lines & INT_NMI) ? INT_NMI : INT_IRQ;
+        
+        // IRQ stays raised until the device lowers it
+        if (type != INT_IRQ) {
+            interruptLines.fetch_and(~type, memory_order_relaxed);
+        }
+        
+        cycles += getCycles(0x0);
+        enterInterrupt(r, r.PC, type);
+    }
+}
+
+/**
+ * Returns whether an interrupt is waiting that the CPU would service, with one load of the lines
+ */
+bool MOS6502::isInterruptPending(const Registers &r) {
+    uint_fast8_t lines = interruptLines.load(memory_order_relaxed);
+    
+    return (lines & (INT_RESET | INT_NMI)) != 0 || ((lines & INT_IRQ) != 0 && (r.P & FLAG_I) == 0);
+}
+
+/**
+ * Ends the slice if an IRQ is raised once the interrupt flag is clear, so it is taken without waiting for the next slice
+ */
+void MOS6502::checkPendingIRQ(const Registers &r) {
+    if ((r.P & FLAG_I) == 0 && (interruptLines.load(memory_order_relaxed) & INT_IRQ) != 0)
+        requestExit();
+}
+
+/**
+ * Executes a single instruction
+ */
+void MOS6502::step(Registers &r, uint_fast32_t &cycles) {
+    uint16_t pc = r.PC;
+    const DecodedInstruction &decoded = decode(pc);
+    
+    r.PC = pc + decoded.length;
+    cycles += decoded.cycles;
+    opcodeFunctions[decoded.opcode](this, r, cycles, pc, decoded.operand);
+}
+
+/**
+ * Executes instructions until the cycle budget is spent or an exit is requested.
+ * Pending interrupts are serviced at the start of the slice.
+ * Returns the number of cycles executed.
+ */
+uint_fast32_t MOS6502::run(uint_fast32_t cycleBudget) {
+    // Working copy of the registers, kept for the whole slice
+    Registers r = registers;
+    uint_fast32_t cycles = 0;
+    
+    startSlice(r, cycles, cycleBudget);
+    
+#ifdef MOS6502_COMPUTED_GOTO
+#define OPCODE_LABEL(opcode, handler) &&op_##opcode,
+    static const void *dispatchTable[256] = { MOS6502_OPCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#endif
+    
+    while (cycles < sliceBudget.load(memory_order_relaxed)) {
+        uint16_t pc = r.PC;
+        const DecodedInstruction &decoded = decode(pc);     // Get the next instruction
+        uint8_t opcode = decoded.opcode;
+        
+        operand = decoded.operand;
+        r.PC = pc + decoded.length;
+        cycles += decoded.cycles;       // Minimum 2 cycles
+        
+        // Jump straight to the handler for the opcode
+#ifdef MOS6502_COMPUTED_GOTO
+#define OPCODE_HANDLER(opcode, handler) op_##opcode: handler; continue;
+        goto *dispatchTable[opcode];
+        MOS6502_OPCODES(OPCODE_HANDLER)
+#else
+#define OPCODE_HANDLER(opcode, handler) case opcode: handler; break;
+        switch (opcode) {
+            MOS6502_OPCODES(OPCODE_HANDLER)
+        }
+#endif
+#undef OPCODE_HANDLER
     }
     
-    // Set start time to when it should have started
-    start_time = goal_time;
+    // Apply changes to the registers
+    registers = r;
+    
+    return cycles;
 }
 
 /**
  * Triggers an interrupt.
  */
 void MOS6502::interrupt(Interrupt type) {
-    pendingInterrupt = type;
+    raiseInterrupt(type);
+}
+
+/**
+ * Raises an interrupt line, which can be done from any thread.
+ * NMI and RESET are lowered once serviced, IRQ stays raised until lowered.
+ */
+void MOS6502::raiseInterrupt(Interrupt line) {
+    interruptLines.fetch_or(line, memory_order_relaxed);
+    requestExit();  // Service at the next slice boundary
+    wake();         // Leave an idle loop
+}
+
+/**
+ * Lowers an interrupt line, as a device does once its interrupt is acknowledged.
+ */
+void MOS6502::lowerInterrupt(Interrupt line) {
+    interruptLines.fetch_and(~line, memory_order_relaxed);
 }
 
 /**
  * Resets the CPU.
+ * The interrupt flag is set as the RESET is serviced.
  */
 void MOS6502::reset() {
-    registers.P |= FLAG_I;  // Set interrupt flag
     interrupt(INT_RESET);   // Trigger a RESET interrupt
 }
 
 /**
- * Triggers an IRQ.
+ * Raises the IRQ line, to be lowered with lowerInterrupt() once the cause is dealt with.
  */
 void MOS6502::irq() {
     interrupt(INT_IRQ);
@@ -995,19 +1484,3 @@ void MOS6502::irq() {
 void MOS6502::nmi() {
     interrupt(INT_NMI);
 }
-
-/**
- * Returns the number of cycles consumed by a particular opcode.
- * Cycle counts are stored in an array for easy lookup.
- */
-uint_fast8_t MOS6502::getCycles(uint8_t opcode) {
-    static const uint_fast8_t cycleMap[] = {7, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, 3, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2,
-        7, 4, 4, 7, 7, 6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, 2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 6, 6,
-        0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, 3, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 6, 6, 0, 8, 3, 3, 5, 5, 4,
-        2, 2, 2, 5, 4, 6, 6, 2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-        3, 6, 0, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, 2, 5, 0, 5, 4, 4, 4,
-        4, 2, 4, 2, 4, 4, 4, 4, 4, 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, 3, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4,
-        7, 7, 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, 2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7};
-    
-    return cycleMap[opcode];
-}
@@ -30,38 +30,73 @@
 #ifndef MOS6502_H
 #define MOS6502_H
 
-#include <chrono>
 #include <cstdint>
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include "CPU.h"
+#include "StateArena.h"
 
 class MOS6502 : public CPU {
+protected:
     /**
      * Registers of the MOS6502 CPU.
      */
-    struct {
+    struct Registers {
         uint8_t A;      // accumulator
         uint8_t X;      // X index
         uint8_t Y;      // Y index
         uint8_t S;      // stack pointer
         uint16_t PC;    // program counter
-        uint8_t P;      // processor flags (NV-BDIZC)
-    } registers;
+        uint8_t P;      // processor flags (NV-BDIZC), only B, D and I are kept here
+        
+        // N, Z, C and V as last computed, assembled into P when it is read
+        uint8_t resultN;    // N is bit 7
+        uint8_t resultZ;    // Z is set when zero
+        uint8_t carry;      // C is bit 0
+        uint8_t overflow;   // V is bit 7
+    };
+    
+    Registers ownRegisters;     // Used when the machine has no state arena with room
+    Registers &registers;       // In the state arena if the machine has one
+    
+    /**
+     * Last short backward branch taken, used to recognize idle loops.
+     */
+    struct {
+        bool valid;             // Set once a branch has been seen in this slice
+        Registers state;        // Registers after the branch
+        uint_fast32_t cycles;   // Slice cycle count after the branch
+    } idleLoop;
     
-    uint16_t newPC;     // tracks what PC will become
+    static const int8_t MAX_IDLE_LOOP = 16;    // Longest loop checked for idling, in bytes
+    
+    /**
+     * Instruction as decoded from memory, cached per address.
+     */
+    struct DecodedInstruction {
+        uint16_t operand;   // Operand bytes, little endian
+        uint8_t opcode;
+        uint8_t length;     // Length in bytes, 0 if not decoded
+        uint8_t cycles;     // Base cycle count
+    };
+    
+    std::vector<DecodedInstruction> decodeCache;    // Indexed by address
+    DecodedInstruction uncached;                    // Last instruction decoded from I/O space
+    uint16_t operand;                               // Operand of the instruction being executed
     
     /**
      * Processor flags.
      */
-    const uint8_t FLAG_N = 0x80;    // sign flag
-    const uint8_t FLAG_V = 0x40;    // overflow flag
-    const uint8_t FLAG_B = 0x10;    // breakpoint flag
-    const uint8_t FLAG_D = 0x8;     // BCD flag
-    const uint8_t FLAG_I = 0x4;     // interrupt flag
-    const uint8_t FLAG_Z = 0x2;     // zero flag
-    const uint8_t FLAG_C = 0x1;     // carry flag
+    static const uint8_t FLAG_N = 0x80;    // sign flag
+    static const uint8_t FLAG_V = 0x40;    // overflow flag
+    static const uint8_t FLAG_B = 0x10;    // breakpoint flag
+    static const uint8_t FLAG_D = 0x8;     // BCD flag
+    static const uint8_t FLAG_I = 0x4;     // interrupt flag
+    static const uint8_t FLAG_Z = 0x2;     // zero flag
+    static const uint8_t FLAG_C = 0x1;     // carry flag
     
     /**
      * Memory addressing modes.
@@ -80,42 +115,125 @@ class MOS6502 : public CPU {
         AM_ZP_IND_Y     // (zp),Y
     };
     
-    uint16_t readPtr(AddressingMode addressingMode);
-    uint8_t readValue(AddressingMode addressingMode);
-    void writeValue(AddressingMode addressingMode, uint8_t value);
+    template<AddressingMode mode> void fetchOperand(Registers &r);
+    template<AddressingMode mode> uint16_t readPtr(Registers &r);
+    template<AddressingMode mode> uint8_t readValue(Registers &r);
+    template<AddressingMode mode> void writeValue(Registers &r, uint8_t value);
+    
+    void setNZ(Registers &r, uint8_t value);    // Set N and Z flags based on value
+    void addWithCarry(Registers &r, uint8_t value);  // ADC/SBC arithmetic
     
-    void setNZ(uint8_t value);  // Set N and Z flags based on value
+    uint8_t getP(const Registers &r);           // Processor flags with N, Z, C and V filled in
+    void setP(Registers &r, uint8_t value);     // Set all processor flags
+    template<uint8_t flag> bool isFlagSet(const Registers &r);
 
-    void push(uint8_t value);   // Push value onto the stack
-    uint8_t pop();              // Pop value from the stack
+    void push(Registers &r, uint8_t value);     // Push value onto the stack
+    uint8_t pop(Registers &r);                  // Pop value from the stack
     
-    void execute();
+    /**
+     * Instruction handlers, dispatched by opcode from run().
+     */
+    template<AddressingMode mode> void opORA(Registers &r);
+    template<AddressingMode mode> void opAND(Registers &r);
+    template<AddressingMode mode> void opEOR(Registers &r);
+    template<AddressingMode mode> void opADC(Registers &r);
+    template<AddressingMode mode> void opSTA(Registers &r);
+    template<AddressingMode mode> void opLDA(Registers &r);
+    template<AddressingMode mode> void opCMP(Registers &r);
+    template<AddressingMode mode> void opSBC(Registers &r);
+    template<AddressingMode mode> void opASL(Registers &r);
+    template<AddressingMode mode> void opROL(Registers &r);
+    template<AddressingMode mode> void opLSR(Registers &r);
+    template<AddressingMode mode> void opROR(Registers &r);
+    template<AddressingMode mode> void opSTX(Registers &r);
+    template<AddressingMode mode> void opLDX(Registers &r);
+    template<AddressingMode mode> void opDEC(Registers &r);
+    template<AddressingMode mode> void opINC(Registers &r);
+    template<AddressingMode mode> void opBIT(Registers &r);
+    template<AddressingMode mode> void opJMP(Registers &r);
+    template<AddressingMode mode> void opJMPIndirect(Registers &r);
+    template<AddressingMode mode> void opSTY(Registers &r);
+    template<AddressingMode mode> void opLDY(Registers &r);
+    template<AddressingMode mode> void opCPY(Registers &r);
+    template<AddressingMode mode> void opCPX(Registers &r);
+    template<uint8_t flag, bool set> void opBranch(Registers &r, uint_fast32_t &cycles);
+    void opBRK(Registers &r, uint16_t pc);
+    void opJSR(Registers &r);
+    void opRTI(Registers &r);
+    void opRTS(Registers &r);
+    void opPHP(Registers &r);
+    void opPLP(Registers &r);
+    void opPHA(Registers &r);
+    void opPLA(Registers &r);
+    void opCLC(Registers &r);
+    void opSEC(Registers &r);
+    void opCLI(Registers &r);
+    void opSEI(Registers &r);
+    void opCLV(Registers &r);
+    void opCLD(Registers &r);
+    void opSED(Registers &r);
+    void opTXA(Registers &r);
+    void opTXS(Registers &r);
+    void opTAX(Registers &r);
+    void opTSX(Registers &r);
+    void opTYA(Registers &r);
+    void opTAY(Registers &r);
+    void opDEX(Registers &r);
+    void opDEY(Registers &r);
+    void opINX(Registers &r);
+    void opINY(Registers &r);
+    void opNOP(Registers &r);
+    void opKIL(Registers &r);
+    
+    /**
+     * Runs the handler(s) for an opcode, as dispatched by run().
+     * Also available as plain functions, indexed by opcode, for callers outside the dispatch loop.
+     */
+    template<uint8_t opcode> void runOpcode(Registers &r, uint_fast32_t &cycles, uint16_t pc);
+    template<uint8_t opcode> static void callOpcode(MOS6502 *cpu, Registers &r, uint_fast32_t &cycles,
+                                                    uint16_t pc, uint16_t operand);
+    typedef void (*OpcodeFunction)(MOS6502 *cpu, Registers &r, uint_fast32_t &cycles, uint16_t pc, uint16_t operand);
+    static const OpcodeFunction opcodeFunctions[256];
     
 public:
     /**
-     * Types of interrupts.
+     * Types of interrupts, each a bit in the interrupt lines.
      */
     enum Interrupt {
-        INT_NONE,
-        INT_BRK,
-        INT_IRQ,
-        INT_NMI,
-        INT_RESET
+        INT_NONE = 0x0,
+        INT_BRK = 0x1,      // Software interrupt, never raised as a line
+        INT_IRQ = 0x2,      // Level-triggered, serviced while raised and not masked
+        INT_NMI = 0x4,      // Edge-triggered, lowered when serviced
+        INT_RESET = 0x8     // Edge-triggered, lowered when serviced
     };
     
-    MOS6502(std::shared_ptr<MemoryMap> memoryMap);
-    ~MOS6502();
+    MOS6502(std::shared_ptr<MemoryMap> memoryMap, StateArena *arena = NULL);
+    virtual ~MOS6502();
+    
+    uint_fast32_t run(uint_fast32_t cycleBudget);
     
     void interrupt(Interrupt type);
+    void raiseInterrupt(Interrupt line);
+    void lowerInterrupt(Interrupt line);
     void reset();
     void irq();
     void nmi();
     
     void dumpState();
     
-private:
-    Interrupt pendingInterrupt;
+protected:
+    std::atomic<uint_fast8_t> interruptLines;   // Raised interrupt lines, changed from any thread
+    void enterInterrupt(Registers &r, uint16_t pc, Interrupt type);
+    bool isInterruptPending(const Registers &r);
+    void checkPendingIRQ(const Registers &r);
     uint_fast8_t getCycles(uint8_t opcode);
+    uint_fast8_t getLength(uint8_t opcode);
+    const DecodedInstruction &decode(uint16_t pc, bool executing = true);
+    virtual void invalidate(uint16_t address);
+    void startSlice(Registers &r, uint_fast32_t &cycles, uint_fast32_t cycleBudget);
+    void step(Registers &r, uint_fast32_t &cycles);
+    void checkIdleLoop(Registers &r, uint_fast32_t cycles, uint16_t branch);
+    bool isIdleLoop(uint16_t start, uint16_t branch);
 };
 
 #endif /* MOS6502_H */
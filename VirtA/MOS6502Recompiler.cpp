@@ -0,0 +1,577 @@
+//
+//  MOS6502Recompiler.cpp
+//  Translates basic blocks of 6502 code to x86-64 code
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "MOS6502Recompiler.h"
+
+#if defined(__x86_64__)
+#define MOS6502_RECOMPILER_X86_64   // Host code is only generated for x86-64
+#endif
+
+using namespace std;
+
+const uint8_t MOS6502Recompiler::HOT_THRESHOLD;
+const uint_fast8_t MOS6502Recompiler::MAX_BLOCK_LENGTH;
+const size_t MOS6502Recompiler::MAX_BLOCK_CODE;
+const size_t MOS6502Recompiler::CODE_BUFFER_SIZE;
+
+// Translated code reads the slice budget directly to see exit requests
+static_assert(sizeof(atomic<uint_fast32_t>) == sizeof(uint_fast32_t), "slice budget must be a plain counter");
+
+#ifdef MOS6502_RECOMPILER_X86_64
+
+/**
+ * Writes x86-64 machine code for translated blocks.
+ * Translated code keeps a pointer to the 6502 registers in RBX and only uses
+ * RAX, RCX and RDX besides the registers used to call out to opcode functions.
+ */
+class X86Emitter {
+    uint8_t *code;
+    
+    void byte(uint8_t value) {
+        *code++ = value;
+    }
+    
+    void word(uint16_t value) {
+        memcpy(code, &value, sizeof(value));
+        code += sizeof(value);
+    }
+    
+    void dword(uint32_t value) {
+        memcpy(code, &value, sizeof(value));
+        code += sizeof(value);
+    }
+    
+    void qword(uint64_t value) {
+        memcpy(code, &value, sizeof(value));
+        code += sizeof(value);
+    }
+    
+    void pointer(const void *value) {
+        qword(reinterpret_cast<uint64_t>(value));
+    }
+    
+public:
+    X86Emitter(uint8_t *code) : code(code) { }
+    
+    uint8_t *position() {
+        return code;
+    }
+    
+    /**
+     * Emits a forward conditional short jump, returning where to patch its target
+     */
+    uint8_t *jumpIf(uint8_t condition) {
+        byte(0x70 | condition);     // jcc rel8
+        byte(0);
+        return code - 1;
+    }
+    
+    /**
+     * Points a jump emitted by jumpIf at the current position
+     */
+    void land(uint8_t *jump) {
+        *jump = static_cast<uint8_t>(code - jump - 1);
+    }
+    
+    void prologue(const void *registers) {
+        byte(0x53);                 // push rbx
+        byte(0x48); byte(0xbb);     // mov rbx, registers
+        pointer(registers);
+    }
+    
+    void epilogue() {
+        byte(0x5b);                 // pop rbx
+        byte(0xc3);                 // ret
+    }
+    
+    /**
+     * Adds to a cycle counter of the width of uint_fast32_t
+     */
+    void addCycles(const uint_fast32_t *cycles, uint32_t value) {
+        if (value == 0)
+            return;
+        
+        byte(0x48); byte(0xb8);     // mov rax, cycles
+        pointer(cycles);
+        if (sizeof(uint_fast32_t) == 8)
+            byte(0x48);             // REX.W
+        byte(0x81); byte(0x00);     // add [rax], value
+        dword(value);
+    }
+    
+    void storeByte(uint8_t offset, uint8_t value) {
+        byte(0xc6); byte(0x43); byte(offset); byte(value);  // mov byte [rbx + offset], value
+    }
+    
+    void storeWord(uint8_t offset, uint16_t value) {
+        byte(0x66); byte(0xc7); byte(0x43); byte(offset);   // mov word [rbx + offset], value
+        word(value);
+    }
+    
+    void loadAL(uint8_t offset) {
+        byte(0x0f); byte(0xb6); byte(0x43); byte(offset);   // movzx eax, byte [rbx + offset]
+    }
+    
+    void storeAL(uint8_t offset) {
+        byte(0x88); byte(0x43); byte(offset);               // mov [rbx + offset], al
+    }
+    
+    void incrementAL() {
+        byte(0xfe); byte(0xc0);     // inc al
+    }
+    
+    void decrementAL() {
+        byte(0xfe); byte(0xc8);     // dec al
+    }
+    
+    void andByte(uint8_t offset, uint8_t value) {
+        byte(0x80); byte(0x63); byte(offset); byte(value);  // and byte [rbx + offset], value
+    }
+    
+    void orByte(uint8_t offset, uint8_t value) {
+        byte(0x80); byte(0x4b); byte(offset); byte(value);  // or byte [rbx + offset], value
+    }
+    
+    void testByte(uint8_t offset, uint8_t value) {
+        byte(0xf6); byte(0x43); byte(offset); byte(value);  // test byte [rbx + offset], value
+    }
+    
+    void compareWord(uint8_t offset, uint16_t value) {
+        byte(0x66); byte(0x81); byte(0x7b); byte(offset);   // cmp word [rbx + offset], value
+        word(value);
+    }
+    
+    void compareFlag(const bool *flag) {
+        byte(0x48); byte(0xb8);     // mov rax, flag
+        pointer(flag);
+        byte(0x80); byte(0x38); byte(0x00);                 // cmp byte [rax], 0
+    }
+    
+    /**
+     * Compares a counter of the width of uint_fast32_t to zero
+     */
+    void compareCount(const void *count) {
+        byte(0x48); byte(0xb8);     // mov rax, count
+        pointer(count);
+        if (sizeof(uint_fast32_t) == 8)
+            byte(0x48);             // REX.W
+        byte(0x83); byte(0x38); byte(0x00);                 // cmp [rax], 0
+    }
+    
+    /**
+     * Calls an opcode function as cpu, registers, cycles, pc, operand
+     */
+    void callOpcode(const void *function, const void *cpu, const uint_fast32_t *cycles, uint16_t pc, uint16_t operand) {
+        byte(0x48); byte(0xbf);     // mov rdi, cpu
+        pointer(cpu);
+        byte(0x48); byte(0x89); byte(0xde);                 // mov rsi, rbx
+        byte(0x48); byte(0xba);     // mov rdx, cycles
+        pointer(cycles);
+        byte(0xb9);                 // mov ecx, pc
+        dword(pc);
+        byte(0x41); byte(0xb8);     // mov r8d, operand
+        dword(operand);
+        byte(0x48); byte(0xb8);     // mov rax, function
+        pointer(function);
+        byte(0xff); byte(0xd0);     // call rax
+    }
+    
+    static const uint8_t CONDITION_E = 0x4;     // Equal or zero
+    static const uint8_t CONDITION_NE = 0x5;    // Not equal or not zero
+};
+
+#endif
+
+/**
+ * Creates a recompiling CPU, which interprets code until it is hot enough to translate
+ */
+MOS6502Recompiler::MOS6502Recompiler(shared_ptr<MemoryMap> memoryMap, StateArena *arena)
+    : MOS6502(memoryMap, arena) {
+    codeBuffer = NULL;
+    codeSize = 0;
+    current = NULL;
+    blockInvalidated = false;
+    cycles = 0;
+    
+    blockAt.resize(0x10000, NULL);
+    heat.resize(0x10000, 0);
+
+#ifdef MOS6502_RECOMPILER_X86_64
+    int flags = MAP_PRIVATE | MAP_ANON;
+#ifdef MAP_JIT
+    flags |= MAP_JIT;   // Required for writable code under the hardened runtime
+#endif
+
+    void *memory = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0);
+    if (memory != MAP_FAILED) {
+        codeBuffer = static_cast<uint8_t *>(memory);
+    } else {
+        cerr << "MOS6502Recompiler: no executable memory, interpreting instead" << endl;
+    }
+#endif
+}
+
+/**
+ * Frees the translated code
+ */
+MOS6502Recompiler::~MOS6502Recompiler() {
+    if (codeBuffer != NULL) {
+        munmap(codeBuffer, CODE_BUFFER_SIZE);
+        codeBuffer = NULL;
+    }
+}
+
+/**
+ * Returns whether code can be translated for the host, otherwise the recompiler only interprets
+ */
+bool MOS6502Recompiler::isSupported() {
+#ifdef MOS6502_RECOMPILER_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Executes instructions until the cycle budget is spent or an exit is requested.
+ * Translated blocks only run when the whole block fits in the budget, so slices
+ * end on the same instruction as with the interpreter.
+ */
+uint_fast32_t MOS6502Recompiler::run(uint_fast32_t cycleBudget) {
+    if (codeBuffer == NULL) {
+        return MOS6502::run(cycleBudget);
+    }
+    
+    cycles = 0;
+    startSlice(registers, cycles, cycleBudget);
+    
+    while (cycles < sliceBudget.load(memory_order_relaxed)) {
+        uint16_t pc = registers.PC;
+        Block *block = blockAt[pc];
+        
+        if (block == NULL && ++heat[pc] >= HOT_THRESHOLD) {
+            block = translate(pc);
+            
+            // Code that cannot be translated is only tried again once it has been run as often again
+            if (block == NULL)
+                heat[pc] = 0;
+        }
+        
+        if (block != NULL && cycles + block->maxCycles <= sliceBudget.load(memory_order_relaxed)) {
+            current = block;
+            blockInvalidated = false;
+            block->code();
+            current = NULL;
+        } else {
+            step(registers, cycles);
+        }
+    }
+    
+    return cycles;
+}
+
+/**
+ * Translates the basic block starting at an address.
+ * Register transfers, immediate loads, flag changes and most branches become host code,
+ * the remaining instructions call the opcode functions of the interpreter. Blocks end at
+ * control flow, or before code in I/O space, which is left to the interpreter.
+ * Returns NULL if not even the first instruction can be translated.
+ */
+MOS6502Recompiler::Block *MOS6502Recompiler::translate(uint16_t start) {
+#ifdef MOS6502_RECOMPILER_X86_64
+    if (CODE_BUFFER_SIZE - codeSize < MAX_BLOCK_CODE) {
+        flush();
+    }
+    
+    uint8_t *code = codeBuffer + codeSize;
+    X86Emitter emitter(code);
+    
+    const uint8_t A = offsetof(Registers, A);
+    const uint8_t X = offsetof(Registers, X);
+    const uint8_t Y = offsetof(Registers, Y);
+    const uint8_t S = offsetof(Registers, S);
+    const uint8_t PC = offsetof(Registers, PC);
+    const uint8_t P = offsetof(Registers, P);
+    const uint8_t RESULT_N = offsetof(Registers, resultN);
+    const uint8_t RESULT_Z = offsetof(Registers, resultZ);
+    const uint8_t CARRY = offsetof(Registers, carry);
+    const uint8_t OVERFLOW = offsetof(Registers, overflow);
+    
+    emitter.prologue(&registers);
+    
+    uint16_t pc = start;
+    uint_fast8_t count = 0;
+    uint_fast32_t maxCycles = 0;
+    uint_fast32_t pending = 0;      // Cycles not yet added to the count
+    bool open = true;               // Whether the block falls through to the next instruction
+    
+    while (open && count < MAX_BLOCK_LENGTH) {
+        decode(pc, false);
+        if (decodeCache[pc].length == 0) {
+            break;  // Not cacheable, so left to the interpreter
+        }
+        
+        DecodedInstruction decoded = decodeCache[pc];
+        uint16_t next = pc + decoded.length;
+        
+        count++;
+        maxCycles += decoded.cycles;
+        pending += decoded.cycles;
+        
+        switch (decoded.opcode) {
+            case 0xa9:  // LDA #
+            case 0xa2:  // LDX #
+            case 0xa0:  // LDY #
+            {
+                uint8_t value = static_cast<uint8_t>(decoded.operand);
+                emitter.storeByte(decoded.opcode == 0xa9 ? A : decoded.opcode == 0xa2 ? X : Y, value);
+                emitter.storeByte(RESULT_N, value);
+                emitter.storeByte(RESULT_Z, value);
+                break;
+            }
+            case 0xaa:  // TAX
+            case 0xa8:  // TAY
+            case 0x8a:  // TXA
+            case 0x98:  // TYA
+            case 0xba:  // TSX
+            {
+                uint8_t from = decoded.opcode == 0x8a ? X : decoded.opcode == 0x98 ? Y : decoded.opcode == 0xba ? S : A;
+                uint8_t to = decoded.opcode == 0xaa || decoded.opcode == 0xba ? X : decoded.opcode == 0xa8 ? Y : A;
+                emitter.loadAL(from);
+                emitter.storeAL(to);
+                emitter.storeAL(RESULT_N);
+                emitter.storeAL(RESULT_Z);
+                break;
+            }
+            case 0xe8:  // INX
+            case 0xc8:  // INY
+            case 0xca:  // DEX
+            case 0x88:  // DEY
+            {
+                uint8_t index = decoded.opcode == 0xe8 || decoded.opcode == 0xca ? X : Y;
+                emitter.loadAL(index);
+                if (decoded.opcode == 0xe8 || decoded.opcode == 0xc8)
+                    emitter.incrementAL();
+                else
+                    emitter.decrementAL();
+                emitter.storeAL(index);
+                emitter.storeAL(RESULT_N);
+                emitter.storeAL(RESULT_Z);
+                break;
+            }
+            case 0x18:  // CLC
+                emitter.storeByte(CARRY, 0);
+                break;
+            case 0x38:  // SEC
+                emitter.storeByte(CARRY, 1);
+                break;
+            case 0xd8:  // CLD
+                emitter.andByte(P, static_cast<uint8_t>(~FLAG_D));
+                break;
+            case 0xf8:  // SED
+                emitter.orByte(P, FLAG_D);
+                break;
+            case 0xb8:  // CLV
+                emitter.storeByte(OVERFLOW, 0);
+                break;
+            case 0xea:  // NOP
+                break;
+            case 0x4c:  // JMP abs
+                emitter.storeWord(PC, decoded.operand);
+                emitter.addCycles(&cycles, pending);
+                emitter.epilogue();
+                open = false;
+                break;
+            case 0x10: case 0x30: case 0x50: case 0x70:     // Branches on N and V
+            case 0x90: case 0xb0: case 0xd0: case 0xf0:     // Branches on C and Z
+            {
+                // Where each flag is kept, and the bits tested; Z is set when the bits are clear
+                const uint8_t flagOffsets[] = {RESULT_N, OVERFLOW, CARRY, RESULT_Z};
+                const uint8_t flagMasks[] = {0x80, 0x80, 0x01, 0xff};
+                uint_fast8_t flag = decoded.opcode >> 6;
+                bool set = ((decoded.opcode & 0x20) != 0) != (flag == 3);
+                int8_t offset = static_cast<int8_t>(decoded.operand);
+                uint16_t target = next + offset;
+                
+                maxCycles += 2;     // Taken, across a page
+                open = false;
+                
+                if (offset < 0 && offset >= -MAX_IDLE_LOOP) {
+                    // Possible idle loop, checked by the interpreter's handler with the count up to date
+                    emitter.addCycles(&cycles, pending);
+                    emitter.storeWord(PC, next);
+                    emitter.callOpcode(reinterpret_cast<const void *>(opcodeFunctions[decoded.opcode]),
+                                       static_cast<MOS6502 *>(this), &cycles, pc, decoded.operand);
+                    emitter.epilogue();
+                    break;
+                }
+                
+                uint_fast32_t taken = 1 + ((target & 0xff00) != (next & 0xff00) ? 1 : 0);
+                
+                emitter.testByte(flagOffsets[flag], flagMasks[flag]);
+                uint8_t *notTaken = emitter.jumpIf(set ? X86Emitter::CONDITION_E : X86Emitter::CONDITION_NE);
+                emitter.storeWord(PC, target);
+                emitter.addCycles(&cycles, pending + taken);
+                emitter.epilogue();
+                emitter.land(notTaken);
+                emitter.storeWord(PC, next);
+                emitter.addCycles(&cycles, pending);
+                emitter.epilogue();
+                break;
+            }
+            default:
+            {
+                // Run the interpreter's handler with PC past the instruction, as it expects
+                emitter.storeWord(PC, next);
+                emitter.callOpcode(reinterpret_cast<const void *>(opcodeFunctions[decoded.opcode]),
+                                   static_cast<MOS6502 *>(this), &cycles, pc, decoded.operand);
+                
+                switch (decoded.opcode) {
+                    case 0x00:  // BRK
+                    case 0x20:  // JSR
+                    case 0x40:  // RTI
+                    case 0x60:  // RTS
+                    case 0x44: case 0x54: case 0x5c:                // JMP
+                    case 0x64: case 0x6c: case 0x74: case 0x7c:     // JMP (indirect)
+                    case 0x02: case 0x22: case 0x42: case 0x62:     // KIL
+                    case 0x82: case 0xc2: case 0xe2:
+                        emitter.addCycles(&cycles, pending);
+                        emitter.epilogue();
+                        open = false;
+                        break;
+                    default:
+                    {
+                        // Leave if the handler wrote to this block, requested an exit or moved PC on by a second operand
+                        emitter.compareFlag(&blockInvalidated);
+                        uint8_t *invalidated = emitter.jumpIf(X86Emitter::CONDITION_NE);
+                        emitter.compareCount(&sliceBudget);
+                        uint8_t *exiting = emitter.jumpIf(X86Emitter::CONDITION_E);
+                        emitter.compareWord(PC, next);
+                        uint8_t *stay = emitter.jumpIf(X86Emitter::CONDITION_E);
+                        emitter.land(invalidated);
+                        emitter.land(exiting);
+                        emitter.addCycles(&cycles, pending);
+                        emitter.epilogue();
+                        emitter.land(stay);
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+        
+        if (open) {
+            pc = next;
+        }
+    }
+    
+    if (count == 0) {
+        return NULL;
+    }
+    
+    if (open) {
+        emitter.storeWord(PC, pc);
+        emitter.addCycles(&cycles, pending);
+        emitter.epilogue();
+    } else {
+        pc += decodeCache[pc].length;
+    }
+    
+    codeSize += emitter.position() - code;
+    
+    Block block;
+    block.start = start;
+    block.length = static_cast<uint16_t>(pc - start);
+    block.maxCycles = maxCycles;
+    block.code = reinterpret_cast<void (*)()>(code);
+    blocks.push_back(block);
+    
+    // Have writes to any of the pages it covers check the block
+    Block *translated = &blocks.back();
+    for (uint_fast32_t page = start >> 8; ; page = (page + 1) & 0xff) {
+        pageBlocks[page].push_back(translated);
+        if (page == (static_cast<uint16_t>(pc - 1) >> 8))
+            break;
+    }
+    
+    blockAt[start] = translated;
+    return translated;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Drops all translated code, to make room for more
+ */
+void MOS6502Recompiler::flush() {
+    fill(blockAt.begin(), blockAt.end(), static_cast<Block *>(NULL));
+    for (uint_fast32_t page = 0; page < 256; page++) {
+        pageBlocks[page].clear();
+    }
+    blocks.clear();
+    codeSize = 0;
+}
+
+/**
+ * Drops decoded instructions and translated blocks that include a byte that was written
+ */
+void MOS6502Recompiler::invalidate(uint16_t address) {
+    MOS6502::invalidate(address);
+    
+    vector<Block *> &candidates = pageBlocks[address >> 8];
+    for (size_t i = 0; i < candidates.size(); ) {
+        Block *block = candidates[i];
+        if (static_cast<uint16_t>(address - block->start) >= block->length) {
+            i++;
+            continue;
+        }
+        
+        if (block == current) {
+            blockInvalidated = true;    // Stop running it after the write
+        }
+        if (blockAt[block->start] == block) {
+            blockAt[block->start] = NULL;
+            heat[block->start] = 0;
+        }
+        
+        candidates[i] = candidates.back();
+        candidates.pop_back();
+    }
+}
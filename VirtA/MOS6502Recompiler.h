@@ -0,0 +1,81 @@
+//
+//  MOS6502Recompiler.h
+//  Interface for MOS6502Recompiler
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef MOS6502Recompiler_H
+#define MOS6502Recompiler_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "MOS6502.h"
+
+class MOS6502Recompiler : public MOS6502 {
+    /**
+     * Basic block translated to host code.
+     */
+    struct Block {
+        uint16_t start;             // Address of the first instruction
+        uint16_t length;            // Bytes of 6502 code translated
+        uint_fast32_t maxCycles;    // Most cycles a run of the block takes
+        void (*code)();             // Translated code
+    };
+    
+    uint8_t *codeBuffer;                    // Executable memory holding translated code
+    size_t codeSize;                        // Bytes of the code buffer in use
+    std::deque<Block> blocks;               // Translated blocks, including dropped ones until the next flush
+    std::vector<Block *> blockAt;           // Block to run for each address
+    std::vector<Block *> pageBlocks[256];   // Blocks covering each page
+    std::vector<uint8_t> heat;              // Times each address was interpreted since it was last translated
+    Block *current;                         // Block being run
+    bool blockInvalidated;                  // Set when the block being run is written to
+    uint_fast32_t cycles;                   // Cycle count of the slice being run
+    
+    static const uint8_t HOT_THRESHOLD = 16;            // Interpretations before an address is translated
+    static const uint_fast8_t MAX_BLOCK_LENGTH = 32;    // Most instructions in a block
+    static const size_t MAX_BLOCK_CODE = 8192;          // Most bytes of host code for a block
+    static const size_t CODE_BUFFER_SIZE = 4 << 20;     // Bytes of executable memory
+    
+    Block *translate(uint16_t start);
+    void flush();
+    void invalidate(uint16_t address);
+    
+public:
+    MOS6502Recompiler(std::shared_ptr<MemoryMap> memoryMap, StateArena *arena = NULL);
+    ~MOS6502Recompiler();
+    
+    uint_fast32_t run(uint_fast32_t cycleBudget);
+    
+    static bool isSupported();
+};
+
+#endif /* MOS6502Recompiler_H */
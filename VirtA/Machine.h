@@ -0,0 +1,149 @@
+//
+//  Machine.h
+//  A machine composed at compile time from a processor and a bus
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Machine_H
+#define Machine_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "MemoryMap.h"
+#include "StateArena.h"
+
+/**
+ * Processor and bus of a machine whose devices never change, such as
+ * Machine<MOS6502, Apple1Bus<ASCIIKeyboard, Apple1VideoTerminal>>. All of its state is
+ * kept in one arena, apart from RAM kept in a file. Which implementation of the processor
+ * runs can still be chosen at run time.
+ */
+template<typename Core, typename Bus>
+class Machine {
+public:
+    typedef std::function<Core *(std::shared_ptr<MemoryMap>, StateArena *)> CoreFactory;
+    
+private:
+    StateArena arena;       // Declared first so it outlives the state it holds
+    std::shared_ptr<MemoryMap> memoryMap;
+    Bus bus;
+    std::shared_ptr<Core> cpu;
+    bool running;
+
+public:
+    template<typename... Devices> Machine(std::string ramFile, CoreFactory makeCore, Devices&&... devices);
+    ~Machine();
+    
+    void start();
+    void stop();
+    
+    Core &getCPU();
+    Bus &getBus();
+    MemoryMap &getMemoryMap();
+    StateArena &getArena();
+};
+
+/**
+ * Builds the machine, passing the devices on to the bus and connecting them to the processor
+ * RAM is kept in ramFile between runs unless it is empty, the processor is made by makeCore if it is set
+ */
+template<typename Core, typename Bus>
+template<typename... Devices>
+Machine<Core, Bus>::Machine(std::string ramFile, CoreFactory makeCore, Devices&&... devices)
+    : memoryMap(ramFile.empty() ? new MemoryMap(Bus::RAM_SIZE, Bus::HIMEM, &arena)
+                                : new MemoryMap(Bus::RAM_SIZE, Bus::HIMEM, ramFile, RAM::BACKING_SHARED)),
+      bus(*memoryMap, &arena, std::forward<Devices>(devices)...),
+      cpu(makeCore ? makeCore(memoryMap, &arena) : new Core(memoryMap, &arena)), running(false) {
+    bus.connect(cpu);
+}
+
+/**
+ * Stops the processor and disconnects it from the devices, which may outlive it
+ */
+template<typename Core, typename Bus>
+Machine<Core, Bus>::~Machine() {
+    stop();
+    bus.disconnect();
+}
+
+/**
+ * Starts the processor thread
+ */
+template<typename Core, typename Bus>
+void Machine<Core, Bus>::start() {
+    if (!running) {
+        cpu->start();
+        running = true;
+    }
+}
+
+/**
+ * Stops the processor thread
+ */
+template<typename Core, typename Bus>
+void Machine<Core, Bus>::stop() {
+    if (running) {
+        cpu->stop();
+        running = false;
+    }
+}
+
+/**
+ * Returns the processor
+ */
+template<typename Core, typename Bus>
+Core &Machine<Core, Bus>::getCPU() {
+    return *cpu;
+}
+
+/**
+ * Returns the bus
+ */
+template<typename Core, typename Bus>
+Bus &Machine<Core, Bus>::getBus() {
+    return bus;
+}
+
+/**
+ * Returns the memory map
+ */
+template<typename Core, typename Bus>
+MemoryMap &Machine<Core, Bus>::getMemoryMap() {
+    return *memoryMap;
+}
+
+/**
+ * Returns the arena holding the machine's state
+ */
+template<typename Core, typename Bus>
+StateArena &Machine<Core, Bus>::getArena() {
+    return arena;
+}
+
+#endif /* Machine_H */
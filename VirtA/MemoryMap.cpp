@@ -30,20 +30,57 @@
 
 #include "MemoryMap.h"
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 
 using namespace std;
 
 /**
  * Initalizes a memory map for the computer. RAM size is specified in kilobytes.
+ * RAM is kept in the machine's state arena if it has one.
  */
-MemoryMap::MemoryMap(uint_fast8_t ramSize, uint16_t himem) {
+MemoryMap::MemoryMap(uint_fast8_t ramSize, uint16_t himem, StateArena *arena) {
     // Size of memory must be a power of two
     assert(((ramSize != 0) && !(ramSize & (ramSize - 1))));
     
-    ram = new RAM(ramSize, himem);
+    ram = new RAM(ramSize, himem, arena);
+    
+    initialize();
+}
+
+/**
+ * Initializes a memory map with RAM backed by a file, shared to keep its contents between
+ * runs or private to start from a template.
+ */
+MemoryMap::MemoryMap(uint_fast8_t ramSize, uint16_t himem, string ramFile, RAM::Backing backing) {
+    // Size of memory must be a power of two
+    assert(((ramSize != 0) && !(ramSize & (ramSize - 1))));
+    
+    ram = new RAM(ramSize, himem, ramFile, backing);
+    
+    initialize();
+}
+
+/**
+ * Sets up the page tables for a map with nothing but RAM
+ */
+void MemoryMap::initialize() {
+    std::fill(unmappedRead, unmappedRead + 256, 0);
+    std::fill(codePages, codePages + 256, false);
+    
+    std::fill(watchPages, watchPages + 256, 0);
+    std::fill(bankedPages, bankedPages + 256, false);
+    
+    dirtyTracking = DIRTY_OFF;
+    for (auto &word: dirty) {
+        word.store(0);
+    }
+    
+    updatePages();
 }
 
 /**
@@ -60,6 +97,8 @@ MemoryMap::~MemoryMap() {
  */
 void MemoryMap::loadROM(uint16_t startAddress, string filename) {
     roms.push_back(unique_ptr<ROM>(new ROM(startAddress, filename)));
+    updatePages();
+    invalidateCode();
 }
 
 /**
@@ -67,6 +106,17 @@ void MemoryMap::loadROM(uint16_t startAddress, string filename) {
  */
 void MemoryMap::loadRAM(uint16_t startAddress, string filename) {
     ram->loadFile(startAddress, filename);
+    invalidateCode();
+    markDirty(0, 0x10000);
+}
+
+/**
+ * Drops what was derived from the contents of memory, after they were replaced
+ * without going through the map, such as by restoring a state arena.
+ */
+void MemoryMap::reload() {
+    invalidateCode();
+    markDirty(0, 0x10000);
 }
 
 /**
@@ -75,17 +125,38 @@ void MemoryMap::loadRAM(uint16_t startAddress, string filename) {
 void MemoryMap::registerInterface(MemoryInterface *interface) {
     interface->setMemoryMap(this);
     interfaces.push_back(interface);
+    updatePages();
+    invalidateCode();
 }
 
 /**
- * Reads a byte from RAM or ROM.
+ * Reads a byte through the page table, for pages that cannot be read directly
  */
-uint8_t MemoryMap::readByte(uint16_t address) {
+uint8_t MemoryMap::readPage(uint16_t address) {
+    const Page<const uint8_t> &page = readPages[address >> 8];
+    uint8_t value;
+    
+    if (page.memory != NULL)
+        value = page.memory[address & 0xff];
+    else if (page.interface != NULL)
+        value = page.interface->readByte(address);
+    else
+        value = readMixed(address);
+    
+    if (watchPages[address >> 8] & WATCH_READ)
+        checkWatch(address, WATCH_READ, value);
+    
+    return value;
+}
+
+/**
+ * Reads a byte from a page shared by several devices
+ */
+uint8_t MemoryMap::readMixed(uint16_t address) {
     // Check whether an interface needs to be notified
-    for(auto const& interface: interfaces) {
-        if (interface->isInRange(address)) {
-            return interface->readByte(address);
-        }
+    MemoryInterface *interface = findInterface(address);
+    if (interface != NULL) {
+        return interface->readByte(address);
     }
     
     // Check whether address is occupied by a ROM
@@ -103,18 +174,44 @@ uint8_t MemoryMap::readByte(uint16_t address) {
 }
 
 /**
- * Reads a word from RAM or ROM.
+ * Writes a byte through the page table, for pages that cannot be written directly
  */
-uint16_t MemoryMap::readWord(uint16_t address) {
-    return static_cast<uint16_t>(readByte(address)) |
-        (static_cast<uint16_t>(readByte((address + 1) & 0xffff)) << 8);
+void MemoryMap::writePage(uint16_t address, uint8_t value) {
+    const Page<uint8_t> &page = writePages[address >> 8];
+    
+    // Reported before the write, so the listener can still see what is overwritten
+    if (watchPages[address >> 8] & WATCH_WRITE)
+        checkWatch(address, WATCH_WRITE, value);
+    
+    if (page.memory == NULL && page.interface == NULL) {
+        writeMixed(address, value);
+        return;
+    }
+    
+    if (page.memory != NULL)
+        page.memory[address & 0xff] = value;
+    if (dirtyTracking != DIRTY_OFF)
+        markDirty(address, 1);
+    
+    // Drop decoded instructions that include the byte
+    if (codePages[address >> 8])
+        codeListener(address);
+    
+    if (page.interface != NULL)
+        page.interface->writeByte(address, value);
 }
 
 /**
- * Writes a byte to RAM.
+ * Writes a byte to a page shared by several devices
  */
-void MemoryMap::writeByte(uint16_t address, uint8_t value) {
+void MemoryMap::writeMixed(uint16_t address, uint8_t value) {
     ram->writeByte(address, value);
+    if (dirtyTracking != DIRTY_OFF)
+        markDirty(address, 1);
+    
+    // Drop decoded instructions that include the byte
+    if (codePages[address >> 8])
+        codeListener(address);
     
     // Check whether a watcher needs to be notified
     for(auto const& interface: interfaces) {
@@ -132,11 +229,533 @@ void MemoryMap::writeWord(uint16_t address, uint16_t value) {
     writeByte(address, static_cast<uint8_t>((value & 0xff00) >> 8));
 }
 
+/**
+ * Reads a block of bytes, wrapping around at the end of the address space.
+ * Plain pages are copied whole, the rest is read a byte at a time.
+ */
+void MemoryMap::readBlock(uint16_t address, uint8_t *buffer, size_t length) {
+    while (length > 0) {
+        size_t offset = address & 0xff;
+        size_t count = min(length, 0x100 - offset);
+        
+        const uint8_t *memory = directReads[address >> 8];
+        if (memory != NULL) {
+            memcpy(buffer, memory + offset, count);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                buffer[i] = readPage(static_cast<uint16_t>(address + i));
+            }
+        }
+        
+        address = static_cast<uint16_t>(address + count);
+        buffer += count;
+        length -= count;
+    }
+}
+
+/**
+ * Writes a block of bytes, wrapping around at the end of the address space.
+ * Plain pages are copied whole, the rest is written a byte at a time.
+ */
+void MemoryMap::writeBlock(uint16_t address, const uint8_t *buffer, size_t length) {
+    while (length > 0) {
+        size_t offset = address & 0xff;
+        size_t count = min(length, 0x100 - offset);
+        
+        uint8_t *memory = getPlainWrite(address >> 8);
+        if (memory != NULL) {
+            memcpy(memory + offset, buffer, count);
+            markDirty(address, count);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                writePage(static_cast<uint16_t>(address + i), buffer[i]);
+            }
+        }
+        
+        address = static_cast<uint16_t>(address + count);
+        buffer += count;
+        length -= count;
+    }
+}
+
+/**
+ * Sets a block of bytes to a value, wrapping around at the end of the address space.
+ * Plain pages are set whole, the rest is written a byte at a time.
+ */
+void MemoryMap::fill(uint16_t address, uint8_t value, size_t length) {
+    while (length > 0) {
+        size_t offset = address & 0xff;
+        size_t count = min(length, 0x100 - offset);
+        
+        uint8_t *memory = getPlainWrite(address >> 8);
+        if (memory != NULL) {
+            memset(memory + offset, value, count);
+            markDirty(address, count);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                writePage(static_cast<uint16_t>(address + i), value);
+            }
+        }
+        
+        address = static_cast<uint16_t>(address + count);
+        length -= count;
+    }
+}
+
+/**
+ * Returns whether reads from an address have no side effects and only change when written,
+ * so what is read may be cached. Addresses handled by an interface are not cacheable.
+ */
+bool MemoryMap::isCacheable(uint16_t address) {
+    if (readPages[address >> 8].interface != NULL) {
+        return false;
+    }
+    
+    // Watched instructions are decoded every time, so the processor reports each time they are run
+    if (watchPages[address >> 8] & WATCH_EXECUTE) {
+        for (auto const& watchpoint: watchpoints) {
+            if ((watchpoint.types & WATCH_EXECUTE) && address >= watchpoint.start &&
+                address < watchpoint.start + watchpoint.length) {
+                return false;
+            }
+        }
+    }
+    
+    if (readPages[address >> 8].memory != NULL) {
+        return true;
+    }
+    
+    return findInterface(address) == NULL;
+}
+
+/**
+ * Marks the page containing an address as holding decoded instructions
+ * Writes to the page are reported to the code listener from then on.
+ */
+void MemoryMap::markCode(uint16_t address) {
+    codePages[address >> 8] = codeListener != nullptr;
+    updateDirectWrite(address >> 8);
+}
+
+/**
+ * Sets the function to be told about writes to code pages, so decoded instructions can be dropped
+ */
+void MemoryMap::setCodeListener(function<void(uint16_t)> listener) {
+    codeListener = listener;
+    std::fill(codePages, codePages + 256, false);
+    
+    for (uint_fast32_t page = 0; page < 256; page++) {
+        updateDirectWrite(page);
+    }
+}
+
+/**
+ * Starts or stops recording which pages or blocks are written, clearing what was recorded.
+ * Plain pages are written through the page table while recording, so it costs nothing when off.
+ * Must not be called while the processor is running.
+ */
+void MemoryMap::setDirtyTracking(DirtyTracking tracking) {
+    dirtyTracking = tracking;
+    for (auto &word: dirty) {
+        word.store(0);
+    }
+    
+    for (uint_fast32_t page = 0; page < 256; page++) {
+        updateDirectWrite(page);
+    }
+}
+
+/**
+ * Returns whether the page or block holding an address was written since it was last taken
+ */
+bool MemoryMap::isDirty(uint16_t address) {
+    if (dirtyTracking == DIRTY_OFF)
+        return false;
+    
+    uint_fast32_t unit = address >> dirtyTracking;
+    return (dirty[unit >> 6].load() >> (unit & 63)) & 1;
+}
+
+/**
+ * Returns the start addresses of the pages or blocks written since they were last taken,
+ * and clears them. Safe to call while the processor is running.
+ */
+vector<uint16_t> MemoryMap::takeDirty() {
+    vector<uint16_t> addresses;
+    if (dirtyTracking == DIRTY_OFF)
+        return addresses;
+    
+    uint_fast32_t words = (0x10000 >> dirtyTracking) / 64;
+    for (uint_fast32_t index = 0; index < words; index++) {
+        uint64_t bits = dirty[index].exchange(0);
+        for (uint_fast32_t bit = 0; bit < 64; bit++) {
+            if ((bits >> bit) & 1)
+                addresses.push_back(static_cast<uint16_t>(((index << 6) + bit) << dirtyTracking));
+        }
+    }
+    
+    return addresses;
+}
+
+/**
+ * Records a range of written bytes, touching the shared bitmap only for newly dirty units
+ */
+void MemoryMap::markDirty(uint16_t address, size_t length) {
+    if (dirtyTracking == DIRTY_OFF || length == 0)
+        return;
+    
+    // Units the range touches, wrapping around at the end of the address space
+    uint_fast32_t unitSize = 1 << dirtyTracking;
+    uint_fast32_t units = 0x10000 >> dirtyTracking;
+    uint_fast32_t first = address >> dirtyTracking;
+    size_t count = min(static_cast<size_t>(units), ((address & (unitSize - 1)) + length + unitSize - 1) >> dirtyTracking);
+    
+    for (size_t i = 0; i < count; i++) {
+        uint_fast32_t unit = (first + i) % units;
+        uint64_t bit = static_cast<uint64_t>(1) << (unit & 63);
+        if (!(dirty[unit >> 6].load(memory_order_relaxed) & bit))
+            dirty[unit >> 6].fetch_or(bit);
+    }
+}
+
+/**
+ * Reports accesses of the given types to a range of addresses to the watch listener.
+ * Only pages holding watchpoints leave the direct path. Must not be called while the processor is running.
+ */
+void MemoryMap::addWatchpoint(uint16_t address, uint_fast32_t length, uint8_t types) {
+    length = min(length, static_cast<uint_fast32_t>(0x10000 - address));
+    if (length == 0)
+        return;
+    
+    Watchpoint watchpoint;
+    watchpoint.start = address;
+    watchpoint.length = length;
+    watchpoint.types = types;
+    watchpoints.push_back(watchpoint);
+    
+    updateWatchPages();
+    
+    // Drop decoded instructions, so execution of the range is seen
+    if (types & WATCH_EXECUTE) {
+        for (uint_fast32_t offset = 0; offset < length; offset++) {
+            uint16_t watched = static_cast<uint16_t>(address + offset);
+            if (codePages[watched >> 8])
+                codeListener(watched);
+        }
+    }
+}
+
+/**
+ * Removes the watchpoints starting at an address. Must not be called while the processor is running.
+ */
+void MemoryMap::removeWatchpoint(uint16_t address) {
+    watchpoints.erase(remove_if(watchpoints.begin(), watchpoints.end(), [address](const Watchpoint &watchpoint) {
+        return watchpoint.start == address;
+    }), watchpoints.end());
+    
+    updateWatchPages();
+}
+
+/**
+ * Removes all watchpoints. Must not be called while the processor is running.
+ */
+void MemoryMap::clearWatchpoints() {
+    watchpoints.clear();
+    updateWatchPages();
+}
+
+/**
+ * Sets the function to be told about watched accesses
+ */
+void MemoryMap::setWatchListener(WatchListener listener) {
+    watchListener = listener;
+}
+
+/**
+ * Reports an opcode fetched from an address that is not cacheable, in case it is being watched
+ */
+void MemoryMap::watchExecute(uint16_t address, uint8_t opcode) {
+    if (watchPages[address >> 8] & WATCH_EXECUTE)
+        checkWatch(address, WATCH_EXECUTE, opcode);
+}
+
+/**
+ * Tells the watch listener about an access if a watchpoint of its type covers the address
+ */
+void MemoryMap::checkWatch(uint16_t address, WatchType type, uint8_t value) {
+    if (watchListener == nullptr)
+        return;
+    
+    for (auto const& watchpoint: watchpoints) {
+        if ((watchpoint.types & type) && address >= watchpoint.start &&
+            address < watchpoint.start + watchpoint.length) {
+            watchListener(address, type, value);
+            return;
+        }
+    }
+}
+
+/**
+ * Recomputes which pages hold watchpoints and takes them off the direct path
+ */
+void MemoryMap::updateWatchPages() {
+    std::fill(watchPages, watchPages + 256, 0);
+    for (auto const& watchpoint: watchpoints) {
+        uint_fast32_t last = (watchpoint.start + watchpoint.length - 1) >> 8;
+        for (uint_fast32_t page = watchpoint.start >> 8; page <= last; page++) {
+            watchPages[page] |= watchpoint.types;
+        }
+    }
+    
+    for (uint_fast32_t page = 0; page < 256; page++) {
+        updateDirectRead(page);
+        updateDirectWrite(page);
+    }
+}
+
+/**
+ * Switches a range of whole pages to a bank, rewriting their page table entries once,
+ * so accesses never look at bank state. The bank memory must cover the range.
+ * Must not be called from another thread while the processor is running.
+ */
+void MemoryMap::switchBank(uint16_t address, uint_fast32_t length, const Bank &bank) {
+    assert((address & 0xff) == 0 && (length & 0xff) == 0 && address + length <= 0x10000);
+    
+    for (uint_fast32_t offset = 0; offset < length; offset += 0x100) {
+        uint8_t page = static_cast<uint8_t>((address + offset) >> 8);
+        
+        banks[page].read = bank.read != NULL ? bank.read + offset : NULL;
+        banks[page].write = bank.write != NULL ? bank.write + offset : NULL;
+        banks[page].interface = bank.interface;
+        bankedPages[page] = true;
+        
+        updatePage(page);
+    }
+    
+    invalidateCode(address, address + length);
+}
+
+/**
+ * Switches a range of whole pages back to the RAM, ROM and interfaces mapped there
+ */
+void MemoryMap::restoreBank(uint16_t address, uint_fast32_t length) {
+    assert((address & 0xff) == 0 && (length & 0xff) == 0 && address + length <= 0x10000);
+    
+    for (uint_fast32_t offset = 0; offset < length; offset += 0x100) {
+        uint8_t page = static_cast<uint8_t>((address + offset) >> 8);
+        
+        bankedPages[page] = false;
+        updatePage(page);
+    }
+    
+    invalidateCode(address, address + length);
+}
+
+/**
+ * Banks out the ROM at an address, so reads from its range go to RAM
+ */
+void MemoryMap::bankOutROM(uint16_t address) {
+    setROMBanked(address, true);
+}
+
+/**
+ * Banks the ROM at an address back in
+ */
+void MemoryMap::bankInROM(uint16_t address) {
+    setROMBanked(address, false);
+}
+
+/**
+ * Banks the ROM at an address in or out, resolving again only the pages it covers
+ */
+void MemoryMap::setROMBanked(uint16_t address, bool bankedOut) {
+    for (auto const& rom: roms) {
+        if (!rom->isInRange(address))
+            continue;
+        
+        if (bankedOut)
+            rom->bankOut();
+        else
+            rom->bankIn();
+        
+        for (uint_fast32_t page = 0; page < 256; page++) {
+            for (uint_fast32_t offset = 0; offset < 256; offset++) {
+                if (rom->isInRange(static_cast<uint16_t>((page << 8) + offset))) {
+                    updatePage(page);
+                    invalidateCode(page << 8, (page + 1) << 8);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+}
+
+/**
+ * Resolves every page to the memory or interface handling all of it
+ */
+void MemoryMap::updatePages() {
+    for (uint_fast32_t page = 0; page < 256; page++) {
+        updatePage(page);
+    }
+}
+
+/**
+ * Resolves a page to the bank switched in, or else the memory or interface handling all of it,
+ * if there is one. Reads go to the first interface in range, else the first ROM in range unless
+ * it is banked out, else RAM. Writes go to RAM and every interface in range.
+ */
+void MemoryMap::updatePage(uint8_t page) {
+    uint16_t start = static_cast<uint16_t>(page << 8);
+    Page<const uint8_t> &read = readPages[page];
+    Page<uint8_t> &write = writePages[page];
+    
+    if (bankedPages[page]) {
+        const Bank &bank = banks[page];
+        
+        // Never left to be resolved per access
+        read.memory = bank.read != NULL || bank.interface != NULL ? bank.read : unmappedRead;
+        read.interface = bank.interface;
+        write.memory = bank.write != NULL || bank.interface != NULL ? bank.write : unmappedWrite;
+        write.interface = bank.interface;
+        
+        updateDirectRead(page);
+        updateDirectWrite(page);
+        return;
+    }
+    
+    read.memory = getReadPointer(start);
+    read.interface = findInterface(start);
+    
+    write.memory = getWritePointer(start);
+    write.interface = read.interface;
+    
+    bool mixedWrites = false;
+    for (uint_fast32_t offset = 1; offset < 256; offset++) {
+        uint16_t address = static_cast<uint16_t>(start + offset);
+        
+        if (read.memory != NULL && getReadPointer(address) != read.memory + offset)
+            read.memory = NULL;
+        if (read.interface != NULL && findInterface(address) != read.interface)
+            read.interface = NULL;
+        if (write.memory != NULL && getWritePointer(address) != write.memory + offset)
+            write.memory = NULL;
+        if (findInterface(address) != write.interface)
+            mixedWrites = true;
+    }
+    
+    // Writes go to all interfaces in range, so a page handled by one must see no other
+    for (auto const& interface: interfaces) {
+        if (interface == write.interface)
+            continue;
+        for (uint_fast32_t offset = 0; offset < 256 && !mixedWrites; offset++) {
+            mixedWrites = interface->isInRange(static_cast<uint16_t>(start + offset));
+        }
+    }
+    
+    if (mixedWrites) {
+        write.memory = NULL;
+        write.interface = NULL;
+    }
+    
+    updateDirectRead(page);
+    updateDirectWrite(page);
+}
+
+/**
+ * Lets reads from a page come straight from memory unless they are watched
+ */
+void MemoryMap::updateDirectRead(uint8_t page) {
+    if (watchPages[page] & WATCH_READ)
+        directReads[page] = NULL;
+    else
+        directReads[page] = readPages[page].memory;
+}
+
+/**
+ * Lets writes to a page go straight to memory if nothing else needs to see them
+ */
+void MemoryMap::updateDirectWrite(uint8_t page) {
+    if (dirtyTracking == DIRTY_OFF)
+        directWrites[page] = getPlainWrite(page);
+    else
+        directWrites[page] = NULL;
+}
+
+/**
+ * Returns the host memory a page is written to if no interface or code listener needs to see it
+ */
+uint8_t *MemoryMap::getPlainWrite(uint8_t page) {
+    const Page<uint8_t> &write = writePages[page];
+    
+    if (write.interface == NULL && !codePages[page] && !(watchPages[page] & WATCH_WRITE))
+        return write.memory;
+    
+    return NULL;
+}
+
+/**
+ * Returns the first interface in range of an address, or NULL
+ */
+MemoryInterface *MemoryMap::findInterface(uint16_t address) {
+    for(auto const& interface: interfaces) {
+        if (interface->isInRange(address)) {
+            return interface;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Returns the host memory a byte is read from, or NULL if an interface handles it
+ */
+const uint8_t *MemoryMap::getReadPointer(uint16_t address) {
+    if (findInterface(address) != NULL) {
+        return NULL;
+    }
+    
+    for(auto const& rom: roms) {
+        if (rom->isInRange(address)) {
+            if (!rom->isBankedOut()) {
+                return rom->getPointer(address);
+            }
+            break;
+        }
+    }
+    
+    uint8_t *pointer = ram->getPointer(address, false);
+    return pointer != NULL ? pointer : unmappedRead + (address & 0xff);
+}
+
+/**
+ * Returns the host memory a byte is written to, whether or not an interface also handles it
+ */
+uint8_t *MemoryMap::getWritePointer(uint16_t address) {
+    uint8_t *pointer = ram->getPointer(address, true);
+    return pointer != NULL ? pointer : unmappedWrite + (address & 0xff);
+}
+
+/**
+ * Reports every byte of the code pages in a range as written, after what the range maps to changed
+ */
+void MemoryMap::invalidateCode(uint_fast32_t start, uint_fast32_t end) {
+    for (uint_fast32_t address = start; address < end; address++) {
+        if (codePages[address >> 8])
+            codeListener(address);
+    }
+}
+
 void MemoryMap::dumpMonitor(uint16_t address, int length) {
+    // Stop at the end of the address space, as reading byte by byte did
+    length = max(0, min(length, 0x10000 - address));
+    vector<uint8_t> bytes(length);
+    readBlock(address, bytes.data(), bytes.size());
+    
     int index = 0;
     cout << endl;
-    for (uint16_t ptr = address; ptr < address + length; ptr++) {
-        cout << hex << (int) readByte(ptr) << " ";
+    for (uint8_t byte: bytes) {
+        cout << hex << (int) byte << " ";
         index++;
         if (index % 20 == 0)
             cout << endl;
@@ -30,8 +30,11 @@
 #ifndef MemoryMap_H
 #define MemoryMap_H
 
+#include <cstddef>
 #include <cstdint>
 
+#include <atomic>
+#include <functional>
 #include <vector>
 #include <string>
 #include <memory>
@@ -41,17 +44,117 @@
 #include "ROM.h"
 #include "MemoryInterface.h"
 
-class MemoryMap : public Memory {
+#if defined(__GNUC__)
+#define MEMORYMAP_INLINE inline __attribute__((always_inline))  // Inlined into the CPU core whatever its size
+#else
+#define MEMORYMAP_INLINE inline
+#endif
+
+class MemoryMap final : public Memory {
+public:
+    /**
+     * Granularity of dirty tracking
+     */
+    enum DirtyTracking {
+        DIRTY_OFF = 0,
+        DIRTY_PAGES = 8,    // One bit per 256 byte page, the value is the shift from an address
+        DIRTY_BLOCKS = 6    // One bit per 64 byte block
+    };
+    
+    /**
+     * Accesses a watchpoint reports, combined as a mask
+     */
+    enum WatchType {
+        WATCH_READ = 1,
+        WATCH_WRITE = 2,
+        WATCH_EXECUTE = 4   // Reported by the processor when it fetches an opcode
+    };
+    
+    typedef std::function<void(uint16_t address, WatchType type, uint8_t value)> WatchListener;
+    
+    /**
+     * Backing store that pages can be switched to, owned by the caller.
+     * With neither memory nor an interface, reads give zero and writes are dropped.
+     */
+    struct Bank {
+        const uint8_t *read;            // Memory reads come from, or NULL
+        uint8_t *write;                 // Memory writes go to, or NULL
+        MemoryInterface *interface;     // Also sees writes, and handles reads if there is no memory
+    };
+    
+private:
     RAM *ram;
     std::vector<std::unique_ptr<ROM>> roms;
     std::vector<MemoryInterface *> interfaces;
+    
+    /**
+     * Where accesses to a page go, resolved whenever the map changes.
+     * Pages with neither set are shared by several devices and resolved per access.
+     */
+    template<typename T> struct Page {
+        T *memory;                      // Host memory backing the whole page
+        MemoryInterface *interface;     // Interface handling the whole page
+    };
+    
+    Page<const uint8_t> readPages[256];     // Indexed by the high byte of the address
+    Page<uint8_t> writePages[256];          // ROM is read-only, so writes only go to RAM
+    uint8_t unmappedRead[256];      // Backs pages without memory, reads as zero
+    uint8_t unmappedWrite[256];     // Takes writes to pages without memory
+    
+    // Host memory that accesses to a page go straight to, for pages without side effects
+    const uint8_t *directReads[256];
+    uint8_t *directWrites[256];     // Not for code pages, whose writes are reported
+    
+    std::function<void(uint16_t)> codeListener;     // Told about writes to code pages
+    bool codePages[256];                            // Pages holding decoded instructions
+    
+    // Written pages or blocks, set by the emulation and taken by consumers on other threads
+    DirtyTracking dirtyTracking;
+    std::atomic<uint64_t> dirty[1024 / 64];
+    
+    /**
+     * Range of addresses reported to the watch listener when accessed.
+     */
+    struct Watchpoint {
+        uint16_t start;
+        uint_fast32_t length;
+        uint8_t types;          // WatchType mask
+    };
+    
+    std::vector<Watchpoint> watchpoints;
+    WatchListener watchListener;
+    uint8_t watchPages[256];        // Types watched anywhere in each page, checked only off the direct path
+    
+    Bank banks[256];                // Bank switched in for each page, offset to the page
+    bool bankedPages[256];          // Pages switched away from what the map resolves them to
+    
+    void updatePages();
+    void updatePage(uint8_t page);
+    void setROMBanked(uint16_t address, bool bankedOut);
+    void updateDirectRead(uint8_t page);
+    void updateDirectWrite(uint8_t page);
+    void updateWatchPages();
+    void checkWatch(uint16_t address, WatchType type, uint8_t value);
+    uint8_t *getPlainWrite(uint8_t page);
+    void markDirty(uint16_t address, size_t length);
+    MemoryInterface *findInterface(uint16_t address);
+    const uint8_t *getReadPointer(uint16_t address);
+    uint8_t *getWritePointer(uint16_t address);
+    uint8_t readPage(uint16_t address);
+    void writePage(uint16_t address, uint8_t value);
+    uint8_t readMixed(uint16_t address);
+    void writeMixed(uint16_t address, uint8_t value);
+    void invalidateCode(uint_fast32_t start = 0, uint_fast32_t end = 0x10000);
+    void initialize();
 
 public:
-    MemoryMap(uint_fast8_t ramSize, uint16_t himem);
+    MemoryMap(uint_fast8_t ramSize, uint16_t himem, StateArena *arena = NULL);
+    MemoryMap(uint_fast8_t ramSize, uint16_t himem, std::string ramFile, RAM::Backing backing);
     ~MemoryMap();
     
     void loadROM(uint16_t startAddress, std::string filename);
     void loadRAM(uint16_t startAddress, std::string filename);
+    void reload();
     void registerInterface(MemoryInterface *interface);
     
     uint8_t readByte(uint16_t address);
@@ -59,7 +162,68 @@ public:
     void writeByte(uint16_t address, uint8_t value);
     void writeWord(uint16_t address, uint16_t value);
     
+    void readBlock(uint16_t address, uint8_t *buffer, size_t length);
+    void writeBlock(uint16_t address, const uint8_t *buffer, size_t length);
+    void fill(uint16_t address, uint8_t value, size_t length);
+    
+    bool isCacheable(uint16_t address);
+    void markCode(uint16_t address);
+    void setCodeListener(std::function<void(uint16_t)> listener);
+    
+    void setDirtyTracking(DirtyTracking tracking);
+    bool isDirty(uint16_t address);
+    std::vector<uint16_t> takeDirty();
+    
+    void addWatchpoint(uint16_t address, uint_fast32_t length, uint8_t types);
+    void removeWatchpoint(uint16_t address);
+    void clearWatchpoints();
+    void setWatchListener(WatchListener listener);
+    void watchExecute(uint16_t address, uint8_t opcode);
+    
+    void switchBank(uint16_t address, uint_fast32_t length, const Bank &bank);
+    void restoreBank(uint16_t address, uint_fast32_t length);
+    void bankOutROM(uint16_t address);
+    void bankInROM(uint16_t address);
+    
     void dumpMonitor(uint16_t address, int length);
 };
 
+/**
+ * Reads a byte, straight from host memory for plain RAM and ROM pages
+ */
+MEMORYMAP_INLINE uint8_t MemoryMap::readByte(uint16_t address) {
+    const uint8_t *memory = directReads[address >> 8];
+    if (memory != NULL)
+        return memory[address & 0xff];
+    
+    return readPage(address);
+}
+
+/**
+ * Writes a byte, straight to host memory for plain RAM pages
+ */
+MEMORYMAP_INLINE void MemoryMap::writeByte(uint16_t address, uint8_t value) {
+    uint8_t *memory = directWrites[address >> 8];
+    if (memory != NULL) {
+        memory[address & 0xff] = value;
+        return;
+    }
+    
+    writePage(address, value);
+}
+
+/**
+ * Reads a little endian word, with a single lookup when both bytes are in the same plain page
+ */
+MEMORYMAP_INLINE uint16_t MemoryMap::readWord(uint16_t address) {
+    const uint8_t *memory = directReads[address >> 8];
+    if (memory != NULL && (address & 0xff) != 0xff) {
+        memory += address & 0xff;
+        return static_cast<uint16_t>(memory[0]) | (static_cast<uint16_t>(memory[1]) << 8);
+    }
+    
+    return static_cast<uint16_t>(readByte(address)) |
+        (static_cast<uint16_t>(readByte((address + 1) & 0xffff)) << 8);
+}
+
 #endif /* MemoryMap_H */
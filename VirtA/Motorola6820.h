@@ -31,21 +31,43 @@
 #define Motorola6820_H
 
 #include <cstdint>
+
+#include <atomic>
 #include <memory>
 
 #include "MemoryInterface.h"
 #include "Peripheral.h"
+#include "StateArena.h"
 
-class Motorola6820 : public MemoryInterface {
-    std::shared_ptr<Peripheral> portA;
-    std::shared_ptr<Peripheral> portB;
+/**
+ * Peripheral Interface Adapter, with the types of the peripherals on its ports known at compile time.
+ * Defaults to reaching them through Peripheral; a machine with fixed peripherals names their
+ * final types, so calls into them are direct and can be inlined.
+ */
+template<typename PortA = Peripheral, typename PortB = Peripheral>
+class Motorola6820 final : public MemoryInterface {
+    std::shared_ptr<PortA> portA;
+    std::shared_ptr<PortB> portB;
     
-    struct {
+    struct Registers {
         uint8_t CRA;    // Control Register A
         uint8_t CRB;    // Control Register B
         uint8_t DDRA;   // Data Direction Register A
         uint8_t DDRB;   // Data Direction Register B
-    } registers;
+    };
+    
+    Registers ownRegisters;     // Used when the machine has no state arena with room
+    Registers &registers;       // In the state arena if the machine has one
+    
+    std::atomic<uint8_t> controlLines;  // Control line signals from the peripherals, not yet latched
+    
+    /**
+     * Control line bits.
+     */
+    static const uint8_t LINE_CA1 = 0x1;
+    static const uint8_t LINE_CA2 = 0x2;
+    static const uint8_t LINE_CB1 = 0x4;
+    static const uint8_t LINE_CB2 = 0x8;
     
     /**
      * Control register flags.
@@ -57,7 +79,8 @@ class Motorola6820 : public MemoryInterface {
     const uint8_t CR_FLAG_CX1 = 0x3;    // Cx1 control flag
     
 public:
-    Motorola6820(uint16_t startAddress, std::shared_ptr<Peripheral> portA, std::shared_ptr<Peripheral> portB);
+    Motorola6820(uint16_t startAddress, std::shared_ptr<PortA> portA, std::shared_ptr<PortB> portB,
+                 StateArena *arena = NULL);
     ~Motorola6820();
     
     void writeByte(uint16_t address, uint8_t value);
@@ -65,5 +88,132 @@ public:
     void reset();
 };
 
+/**
+ * Sets up a 6820 at the given address with the given peripherals,
+ * keeping its registers in the machine's state arena if it has one
+ */
+template<typename PortA, typename PortB>
+Motorola6820<PortA, PortB>::Motorola6820(uint16_t startAddress, std::shared_ptr<PortA> portA,
+                                         std::shared_ptr<PortB> portB, StateArena *arena)
+    : MemoryInterface(startAddress, 2048), portA(portA), portB(portB),
+      registers(allocateState(arena, ownRegisters)), controlLines(0) {
+    reset();
+    
+    if (portA != NULL)
+        portA->connect(&controlLines, LINE_CA1, LINE_CA2);
+    if (portB != NULL)
+        portB->connect(&controlLines, LINE_CB1, LINE_CB2);
+}
+
+/**
+ * Disconnects the peripherals
+ */
+template<typename PortA, typename PortB>
+Motorola6820<PortA, PortB>::~Motorola6820() {
+    if (portA != NULL)
+        portA->connect(NULL, 0, 0);
+    if (portB != NULL)
+        portB->connect(NULL, 0, 0);
+}
+
+/**
+ * Writes a byte to the 6820
+ */
+template<typename PortA, typename PortB>
+void Motorola6820<PortA, PortB>::writeByte(uint16_t address, uint8_t value) {
+    uint16_t maskedAddress = address & 0x1f;    // Get relevant bits of address
+    
+    switch(maskedAddress) {
+        case 0x10:  // Write data (port A)
+            if ((registers.CRB & CR_FLAG_DDR) == CR_FLAG_DDR) {     // Check DDR line
+                if (portA != NULL)
+                    portA->write(value & registers.DDRA);
+            } else {
+                registers.DDRB = value;
+            }
+            break;
+        case 0x11:  // Write CRA
+            registers.CRA = (registers.CRA & (CR_FLAG_IRQ1 | CR_FLAG_IRQ2)) | (value & ~(CR_FLAG_IRQ1 | CR_FLAG_IRQ2));   // IRQ flags are only set by the control lines
+            break;
+        case 0x12:  // Write data (port B)
+            if ((registers.CRB & CR_FLAG_DDR) == CR_FLAG_DDR) {     // Check DDR line
+                if (portB != NULL)
+                    portB->write(value & registers.DDRB);
+            } else {
+                registers.DDRB = value;
+            }
+            break;
+        case 0x13:  // Write CRB
+            registers.CRB = (registers.CRB & (CR_FLAG_IRQ1 | CR_FLAG_IRQ2)) | (value & ~(CR_FLAG_IRQ1 | CR_FLAG_IRQ2));   // IRQ flags are only set by the control lines
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Reads a byte from the 6820
+ */
+template<typename PortA, typename PortB>
+uint8_t Motorola6820<PortA, PortB>::readByte(uint16_t address) {
+    uint16_t maskedAddress = address & 0x1f;    // Get relevant bits of address
+    uint8_t result = 0;
+    
+    // Update CRs with the control lines signalled since the last read, with one load when there are none
+    if (controlLines.load(std::memory_order_relaxed) != 0) {
+        uint8_t lines = controlLines.exchange(0, std::memory_order_acquire);
+        
+        if (lines & LINE_CA1)
+            registers.CRA |= CR_FLAG_IRQ1;
+        if (lines & LINE_CA2)
+            registers.CRA |= CR_FLAG_IRQ2;
+        if (lines & LINE_CB1)
+            registers.CRB |= CR_FLAG_IRQ1;
+        if (lines & LINE_CB2)
+            registers.CRB |= CR_FLAG_IRQ2;
+    }
+    
+    switch(maskedAddress) {
+        case 0x10:  // Read receive data
+            if ((registers.CRA & CR_FLAG_DDR) == CR_FLAG_DDR) {     // Check DDR line
+                if (portA != NULL)
+                    result = portA->read() & ~registers.DDRA;  // Return keypress
+                registers.CRA &= ~CR_FLAG_IRQ1;     // Clear IRQ1
+            } else {
+                result = registers.DDRA;
+            }
+            break;
+        case 0x11:  // Read receive status
+            return registers.CRA & ~CR_FLAG_CX1;    // CA1 is input only
+            break;
+        case 0x12:  // Read display status
+            if ((registers.CRB & CR_FLAG_DDR) == CR_FLAG_DDR) {     // Check DDR line
+                if (portB != NULL)
+                    result = portB->read() & ~registers.DDRB;     // 0x0 Ready    0x80 Not Ready
+                registers.CRB &= ~CR_FLAG_IRQ1;
+            } else {
+                result = registers.DDRB;
+            }
+            break;
+        case 0x13:
+            return registers.CRB & ~CR_FLAG_CX1;    // CB1 is input only
+            break;
+        default:    // Invalid address
+            break;
+    }
+    
+    return result;
+}
+
+/**
+ * Sets the default register values on the 6820
+ */
+template<typename PortA, typename PortB>
+void Motorola6820<PortA, PortB>::reset() {
+    registers.CRA = 0x0;
+    registers.CRB = 0x0;
+    registers.DDRA = 0x0;
+    registers.DDRB = 0x0;
+}
 
 #endif /* Motorola6820_H */
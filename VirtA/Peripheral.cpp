@@ -28,30 +28,55 @@
 //  SOFTWARE.
 //
 
+#include <cstddef>
+
 #include "Peripheral.h"
 
+using namespace std;
+
+/**
+ * Sets up a peripheral, not yet connected to an interface
+ */
+Peripheral::Peripheral() : controlLines(NULL), line1(0), line2(0) { }
+
+/**
+ * Connects the peripheral's control lines to bits of an interface's control lines
+ * Passing NULL disconnects it, which is only safe once nothing else can signal
+ */
+void Peripheral::connect(atomic<uint8_t> *controlLines, uint8_t line1, uint8_t line2) {
+    this->controlLines = controlLines;
+    this->line1 = line1;
+    this->line2 = line2;
+}
+
+/**
+ * Signals control line 1, from any thread
+ * Anything written before is seen by the interface once it sees the signal
+ */
+void Peripheral::raise1() {
+    if (controlLines != NULL)
+        controlLines->fetch_or(line1, memory_order_release);
+}
+
 /**
- * Sets up a peripheral
+ * Signals control line 2, from any thread
  */
-Peripheral::Peripheral() {
-    irq1 = false;
-    irq2 = false;
+void Peripheral::raise2() {
+    if (controlLines != NULL)
+        controlLines->fetch_or(line2, memory_order_release);
 }
 
 /**
- * Checks and resets interrupt line 1
+ * Sets a function to be called when the state of the peripheral changes
  */
-bool Peripheral::interrupt1() {
-    bool result = irq1;
-    irq1 = false;
-    return result;
+void Peripheral::setListener(function<void()> listener) {
+    this->listener = listener;
 }
 
 /**
- * Checks and resets interrupt line 2
+ * Tells the listener, if any, that the state of the peripheral has changed
  */
-bool Peripheral::interrupt2() {
-    bool result = irq2;
-    irq2 = false;
-    return result;
+void Peripheral::notify() {
+    if (listener)
+        listener();
 }
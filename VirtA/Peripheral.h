@@ -32,10 +32,19 @@
 
 #include <cstdint>
 
+#include <atomic>
+#include <functional>
+
 class Peripheral {
+    std::function<void()> listener;
+    std::atomic<uint8_t> *controlLines;     // Lines of the interface the peripheral is connected to, if any
+    uint8_t line1;                          // Bit of control line 1 in controlLines
+    uint8_t line2;                          // Bit of control line 2 in controlLines
+    
 protected:
-    bool irq1;
-    bool irq2;
+    void notify();
+    void raise1();
+    void raise2();
     
 public:
     Peripheral();
@@ -43,8 +52,8 @@ public:
     
     virtual uint8_t read() = 0;
     virtual void write(uint8_t value) = 0;
-    virtual bool interrupt1();
-    virtual bool interrupt2();
+    void connect(std::atomic<uint8_t> *controlLines, uint8_t line1, uint8_t line2);
+    void setListener(std::function<void()> listener);
 };
 
 #endif /* Peripheral_H */
@@ -30,46 +30,143 @@
 
 #include <algorithm>
 #include <fstream>
+#include <iostream>
 
 #include <cassert>
 #include <cstdint>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "RAM.h"
 
 using namespace std;
 
 /**
- * Initializes internal storage for the memory
+ * Initializes internal storage for the memory, from the machine's state arena if it has one with room
+ */
+RAM::RAM(uint_fast8_t kb, uint16_t himem, StateArena *arena) : himem(himem) {
+    setSize(kb);
+    
+    memory = arena != NULL ? static_cast<uint8_t *>(arena->allocate(extent)) : NULL;
+    if (memory != NULL) {
+        storage = STORAGE_ARENA;
+    } else {
+        memory = new uint8_t[extent];
+        storage = STORAGE_ALLOCATED;
+    }
+}
+
+/**
+ * Initializes storage for the memory from a file, so its contents can outlive the machine.
+ * Falls back to allocated memory if the file cannot be mapped.
+ */
+RAM::RAM(uint_fast8_t kb, uint16_t himem, string filename, Backing backing) : himem(himem) {
+    setSize(kb);
+    
+    storage = STORAGE_FILE;
+    if (!mapFile(filename, backing)) {
+        cerr << "RAM: cannot map " << filename << ", using memory instead" << endl;
+        memory = new uint8_t[extent];
+        storage = STORAGE_ALLOCATED;
+    }
+}
+
+/**
+ * Frees the internal storage for the memory
+ */
+RAM::~RAM() {
+    // Free the memory, writing a shared mapping back to its file, unless the arena owns it
+    if (storage == STORAGE_FILE) {
+        munmap(memory, extent);
+    } else if (storage == STORAGE_ALLOCATED) {
+        delete[] memory;
+    }
+}
+
+/**
+ * Computes the size of the memory and of its storage
  */
-RAM::RAM(uint_fast8_t kb, uint16_t himem) : himem(himem) {
+void RAM::setSize(uint_fast8_t kb) {
     // Size of memory must be a power of two
     assert(((kb != 0) && !(kb & (kb - 1))));
     
-    // Compute and initialize memory
+    // Storage includes the disjoint segment, which is addressed directly
     size = kb * 1024;
-    memory = new uint8_t[size];
+    extent = size;
+    if (himem > 0 && size >= 0x1000) {
+        extent = max(extent, static_cast<uint_fast32_t>(himem + size - 0x1000));
+    }
 }
 
 /**
- * Frees the internal storage for the memory
+ * Maps the storage from a file.
+ * A shared file is extended to hold all of the memory. A private file may be shorter,
+ * the rest of the memory then starts out as zero.
  */
-RAM::~RAM() {
-    // Free the memory
-    delete memory;
+bool RAM::mapFile(string filename, Backing backing) {
+    int fd = open(filename.c_str(), backing == BACKING_SHARED ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        return false;
+    }
+    
+    void *mapping = MAP_FAILED;
+    if (backing == BACKING_SHARED) {
+        if (static_cast<uint_fast32_t>(status.st_size) >= extent || ftruncate(fd, extent) == 0) {
+            mapping = mmap(NULL, extent, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+    } else {
+        // Zeroed memory, with as much of the file as it has copied in on write
+        mapping = mmap(NULL, extent, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        size_t length = min(static_cast<size_t>(status.st_size), static_cast<size_t>(extent));
+        if (mapping != MAP_FAILED && length > 0 &&
+            mmap(mapping, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(mapping, extent);
+            mapping = MAP_FAILED;
+        }
+    }
+    
+    close(fd);  // The mapping stays valid
+    
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    
+    memory = static_cast<uint8_t *>(mapping);
+    return true;
 }
 
 /**
- * Reads a byte from memory
+ * Checks whether an address is backed by memory, for reading or writing
  */
-uint8_t RAM::readByte(uint16_t address) {
+bool RAM::isMapped(uint16_t address, bool write) {
     // Check whether the range is valid
     if (address >= size) {
         // Check for disjoint memory segment above 1000
-        if (!((himem > 0 && size > 0x1000) && (address < himem + size - 0x1000))) {
-            return 0;
+        if (!((himem > 0 && (write ? size >= 0x1000 : size > 0x1000)) && (address < himem + size - 0x1000))) {
+            return false;
         }
     }
     
+    return true;
+}
+
+/**
+ * Reads a byte from memory
+ */
+uint8_t RAM::readByte(uint16_t address) {
+    if (!isMapped(address, false)) {
+        return 0;
+    }
+    
     return memory[address];
 }
 
@@ -77,24 +174,37 @@ uint8_t RAM::readByte(uint16_t address) {
  * Writes a byte to memory
  */
 void RAM::writeByte(uint16_t address, uint8_t value) {
-    // Check whether the range is valid
-    if (address >= size) {
-        // Check for disjoint memory segment above 1000
-        if (!((himem > 0 && size >= 0x1000) && (address < himem + size - 0x1000))) {
-            return;
-        }
+    if (!isMapped(address, true)) {
+        return;
     }
     
     // Set the value
     memory[address] = value;
 }
 
+/**
+ * Returns the host memory holding a byte, or NULL if the address is not backed by memory
+ */
+uint8_t *RAM::getPointer(uint16_t address, bool write) {
+    if (!isMapped(address, write)) {
+        return NULL;
+    }
+    
+    return memory + address;
+}
+
 void RAM::loadFile(uint16_t startAddress, string filename) {
     // Create a stream pointing to the file
     ifstream input(filename, std::ios::binary | std::ios::ate);
     streamsize size = input.tellg();
     input.seekg(0, std::ios::beg);
     
+    // Read no further than the end of the storage
+    if (startAddress >= extent || size <= 0) {
+        return;
+    }
+    size = min(size, static_cast<streamsize>(extent - startAddress));
+    
     // Read and close the file
     input.read(reinterpret_cast<char *>(memory + startAddress), size);
     input.close();
@@ -35,18 +35,43 @@
 #include <cstdint>
 
 #include "Memory.h"
+#include "StateArena.h"
 
 class RAM : public Memory {
+public:
+    /**
+     * Ways of backing memory with a file.
+     */
+    enum Backing {
+        BACKING_SHARED,     // Writes go back to the file
+        BACKING_PRIVATE     // The file is a template, writes stay in memory
+    };
+
+private:
     uint8_t *memory;
     uint_fast32_t size;
+    uint_fast32_t extent;   // Bytes of storage, up to the end of the disjoint segment
     uint16_t himem;    // Disjoint high memory area
     
+    // Where the storage comes from, which decides how it is freed
+    enum {
+        STORAGE_ALLOCATED,
+        STORAGE_FILE,
+        STORAGE_ARENA
+    } storage;
+    
+    void setSize(uint_fast8_t kb);
+    bool mapFile(std::string filename, Backing backing);
+    bool isMapped(uint16_t address, bool write);
+
 public:
-    RAM(uint_fast8_t kb, uint16_t himem);
+    RAM(uint_fast8_t kb, uint16_t himem, StateArena *arena = NULL);
+    RAM(uint_fast8_t kb, uint16_t himem, std::string filename, Backing backing);
     ~RAM();
     
     uint8_t readByte(uint16_t address);
     void writeByte(uint16_t address, uint8_t value);
+    uint8_t *getPointer(uint16_t address, bool write);
     void loadFile(uint16_t address, std::string filename);
 };
 
@@ -31,7 +31,6 @@
 #include <cassert>
 #include <cstdint>
 
-#include <fstream>
 #include <algorithm>
 
 #include "ROM.h"
@@ -39,39 +38,45 @@
 using namespace std;
 
 /**
- * Loads the ROM into internal storage
+ * Maps the ROM image, sharing it if the file is already mapped
  */
 ROM::ROM(uint16_t startAddress, string filename) : startAddress(startAddress) {
-    // Create a stream pointing to the file
-    ifstream input(filename, std::ios::binary | std::ios::ate);
-    streamsize ssize = input.tellg();
-    input.seekg(0, std::ios::beg);
+    image = ROMImage::load(filename);
+    memory = image->getData();
     
-    // Compute and initialize memory, checking bounds of addressable memory
-    size = min(static_cast<uint32_t>(ssize), static_cast<uint32_t>(0x10000 - startAddress));
-    memory = new uint8_t[size];
-
-    // Read and close the file
-    input.read(reinterpret_cast<char *>(memory), size);
-    input.close();
+    // Check bounds of addressable memory
+    size = min(static_cast<uint32_t>(image->getSize()), static_cast<uint32_t>(0x10000 - startAddress));
     
     // ROM is not banked out by default
     bankedOut = false;
 }
 
 /**
- * Frees the internal storage for the memory
+ * Releases the ROM image, which is unmapped once no ROM uses it
  */
 ROM::~ROM() {
-    // Free the memory
-    delete memory;
+    memory = NULL;
+    image.reset();
 }
 
 /**
  * Reads a byte from memory
+ * Reads past the end of the image, or of an image that could not be loaded, return 0
  */
 uint8_t ROM::readByte(uint16_t address) {
-    return memory[address - startAddress];
+    uint_fast32_t offset = static_cast<uint16_t>(address - startAddress);
+    
+    if (offset >= size)
+        return 0;
+    
+    return memory[offset];
+}
+
+/**
+ * Returns the host memory holding a byte, which must be in range
+ */
+const uint8_t *ROM::getPointer(uint16_t address) {
+    return memory + (address - startAddress);
 }
 
 /**
@@ -32,12 +32,15 @@
 
 #include <cstdint>
 
+#include <memory>
 #include <string>
 
 #include "Memory.h"
+#include "ROMImage.h"
 
 class ROM : public Memory {
-    uint8_t *memory;
+    std::shared_ptr<ROMImage> image;    // Shared with every ROM loaded from the same file
+    const uint8_t *memory;
     uint_fast32_t size;
     uint16_t startAddress;
     bool bankedOut;
@@ -48,6 +51,7 @@ public:
     
     uint8_t readByte(uint16_t address);
     void writeByte(uint16_t address, uint8_t value);
+    const uint8_t *getPointer(uint16_t address);
     
     bool isInRange(uint16_t address);
     bool isBankedOut();
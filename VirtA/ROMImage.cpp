@@ -0,0 +1,108 @@
+//
+//  ROMImage.cpp
+//  Read-only ROM images mapped from files and shared across machines
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ROMImage.h"
+
+using namespace std;
+
+map<string, weak_ptr<ROMImage>> ROMImage::cache;
+mutex ROMImage::cacheMutex;
+
+/**
+ * Maps a file read-only, leaving the image empty if it cannot be mapped
+ */
+ROMImage::ROMImage(const string &filename) {
+    data = NULL;
+    size = 0;
+    
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "ROMImage: cannot open " << filename << endl;
+        return;
+    }
+    
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+        void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(mapping);
+            size = status.st_size;
+        } else {
+            cerr << "ROMImage: cannot map " << filename << endl;
+        }
+    }
+    
+    close(fd);  // The mapping stays valid
+}
+
+/**
+ * Unmaps the file
+ */
+ROMImage::~ROMImage() {
+    if (data != NULL) {
+        munmap(const_cast<uint8_t *>(data), size);
+        data = NULL;
+    }
+}
+
+/**
+ * Returns the image of a file, mapping it unless it is already in use
+ */
+shared_ptr<ROMImage> ROMImage::load(const string &filename) {
+    lock_guard<mutex> lock(cacheMutex);
+    
+    shared_ptr<ROMImage> image = cache[filename].lock();
+    if (!image) {
+        image = shared_ptr<ROMImage>(new ROMImage(filename));
+        cache[filename] = image;
+    }
+    
+    return image;
+}
+
+/**
+ * Returns the contents of the image
+ */
+const uint8_t *ROMImage::getData() {
+    return data;
+}
+
+/**
+ * Returns the size of the image in bytes
+ */
+size_t ROMImage::getSize() {
+    return size;
+}
@@ -0,0 +1,59 @@
+//
+//  ROMImage.h
+//  Interface for ROMImage
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef ROMImage_H
+#define ROMImage_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class ROMImage {
+    const uint8_t *data;    // Read-only mapping of the file
+    size_t size;
+    
+    static std::map<std::string, std::weak_ptr<ROMImage>> cache;    // Images in use, by file name
+    static std::mutex cacheMutex;
+    
+    ROMImage(const std::string &filename);
+
+public:
+    ~ROMImage();
+    
+    static std::shared_ptr<ROMImage> load(const std::string &filename);
+    
+    const uint8_t *getData();
+    size_t getSize();
+};
+
+#endif /* ROMImage_H */
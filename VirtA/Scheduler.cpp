@@ -0,0 +1,73 @@
+//
+//  Scheduler.cpp
+//  Queue of device events ordered by emulated cycle
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <utility>
+
+#include "Scheduler.h"
+
+using namespace std;
+
+const uint_fast64_t Scheduler::NO_EVENT;
+
+/**
+ * Orders events by cycle, then by when they were scheduled
+ */
+bool Scheduler::Event::operator>(const Event &other) const {
+    return cycle != other.cycle ? cycle > other.cycle : order > other.order;
+}
+
+/**
+ * Sets up an empty scheduler
+ */
+Scheduler::Scheduler() : scheduled(0) { }
+
+/**
+ * Has the callback run once the given cycle is reached
+ */
+void Scheduler::schedule(uint_fast64_t cycle, function<void()> callback) {
+    events.push(Event{cycle, scheduled++, move(callback)});
+}
+
+/**
+ * Returns the cycle the next event is due at, or NO_EVENT if there is none
+ */
+uint_fast64_t Scheduler::nextEvent() {
+    return events.empty() ? NO_EVENT : events.top().cycle;
+}
+
+/**
+ * Runs the events due by the given cycle, including any they schedule in turn
+ */
+void Scheduler::runUntil(uint_fast64_t cycle) {
+    while (!events.empty() && events.top().cycle <= cycle) {
+        function<void()> callback = events.top().callback;
+        events.pop();
+        callback();
+    }
+}
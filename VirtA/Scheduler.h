@@ -0,0 +1,66 @@
+//
+//  Scheduler.h
+//  Interface for Scheduler
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef Scheduler_H
+#define Scheduler_H
+
+#include <cstdint>
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+/**
+ * Device events ordered by the cycle they are due at.
+ * Events due at the same cycle run in the order they were scheduled.
+ * Used on the CPU thread only.
+ */
+class Scheduler {
+    struct Event {
+        uint_fast64_t cycle;                // Cycle the event is due at
+        uint_fast64_t order;                // Tie-breaker, increasing with each event scheduled
+        std::function<void()> callback;
+        
+        bool operator>(const Event &other) const;
+    };
+    
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint_fast64_t scheduled;    // Events scheduled so far
+
+public:
+    static const uint_fast64_t NO_EVENT = UINT64_MAX;   // Next event cycle when none is scheduled
+    
+    Scheduler();
+    
+    void schedule(uint_fast64_t cycle, std::function<void()> callback);
+    uint_fast64_t nextEvent();
+    void runUntil(uint_fast64_t cycle);
+};
+
+#endif /* Scheduler_H */
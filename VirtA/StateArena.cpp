@@ -0,0 +1,120 @@
+//
+//  StateArena.cpp
+//  Contiguous, cache-aligned storage for the state of a machine
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#include <iostream>
+
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "StateArena.h"
+
+using namespace std;
+
+/**
+ * Reserves a zeroed, page aligned block
+ */
+StateArena::StateArena(size_t capacity) : capacity(capacity), size(0) {
+    void *mapping = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (mapping == MAP_FAILED) {
+        cerr << "StateArena: cannot reserve " << capacity << " bytes" << endl;
+        mapping = NULL;
+        this->capacity = 0;
+    }
+    
+    data = static_cast<uint8_t *>(mapping);
+}
+
+/**
+ * Releases the block
+ */
+StateArena::~StateArena() {
+    if (data != NULL)
+        munmap(data, capacity);
+}
+
+/**
+ * Returns zeroed storage at the start of the next cache line. The storage lasts as long as the arena.
+ * Returns NULL if the arena is full or could not be reserved.
+ */
+void *StateArena::allocate(size_t length) {
+    size_t offset = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (data == NULL || offset > capacity || length > capacity - offset) {
+        cerr << "StateArena: cannot allocate " << length << " bytes" << endl;
+        return NULL;
+    }
+    
+    size = offset + length;
+    return data + offset;
+}
+
+/**
+ * Returns the allocated part of the block
+ */
+const uint8_t *StateArena::getData() {
+    return data;
+}
+
+/**
+ * Returns the number of bytes allocated
+ */
+size_t StateArena::getSize() {
+    return size;
+}
+
+/**
+ * Returns a copy of the state. The machine must not be running.
+ */
+vector<uint8_t> StateArena::save() {
+    return vector<uint8_t>(data, data + size);
+}
+
+/**
+ * Restores state saved from an arena with the same layout. The machine must not be running.
+ * Returns false, leaving the state alone, if the layout differs.
+ */
+bool StateArena::restore(const vector<uint8_t> &state) {
+    if (state.size() != size)
+        return false;
+    
+    memcpy(data, state.data(), size);
+    return true;
+}
+
+/**
+ * Copies the state of another machine built the same way. Neither machine may be running.
+ * Returns false, leaving the state alone, if the layout differs.
+ */
+bool StateArena::copyFrom(StateArena &other) {
+    if (other.size != size)
+        return false;
+    
+    memcpy(data, other.data, size);
+    return true;
+}
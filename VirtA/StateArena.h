@@ -0,0 +1,82 @@
+//
+//  StateArena.h
+//  Interface for StateArena
+//
+//  Created on 2026/10/17.
+//
+//  MIT License
+//
+//  Copyright (c) 2017 Lionel Pinkhard
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//
+
+#ifndef StateArena_H
+#define StateArena_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <type_traits>
+#include <vector>
+
+/**
+ * Single block holding the state of one machine, laid out in the order it is allocated.
+ * Holds only plain data, so saving, restoring or cloning a machine is a copy of the block.
+ */
+class StateArena {
+    uint8_t *data;      // Reserved block, only touched pages take memory
+    size_t capacity;    // Bytes reserved
+    size_t size;        // Bytes allocated
+
+public:
+    static const size_t ALIGNMENT = 64;                     // Each allocation starts a cache line
+    static const size_t DEFAULT_CAPACITY = 1 << 20;
+    
+    StateArena(size_t capacity = DEFAULT_CAPACITY);
+    ~StateArena();
+    
+    void *allocate(size_t length);
+    template<typename T> T *allocate();
+    
+    const uint8_t *getData();
+    size_t getSize();
+    
+    std::vector<uint8_t> save();
+    bool restore(const std::vector<uint8_t> &state);
+    bool copyFrom(StateArena &other);
+};
+
+/**
+ * Allocates zeroed storage for a plain type
+ */
+template<typename T> T *StateArena::allocate() {
+    static_assert(std::is_trivial<T>::value, "State is copied as bytes");
+    return static_cast<T *>(allocate(sizeof(T)));
+}
+
+/**
+ * Returns storage for a plain type in the arena, or the given storage without an arena or room in it
+ */
+template<typename T> T &allocateState(StateArena *arena, T &fallback) {
+    T *state = arena != NULL ? arena->allocate<T>() : NULL;
+    return state != NULL ? *state : fallback;
+}
+
+#endif /* StateArena_H */
@@ -145,11 +145,12 @@ void TelnetServer::process() {
                         if (buf[i] == 0xa)  // Skip CR (LF becomes CR)
                             continue;
                         
-                        // Handle input on the client socket
-                        input->keypress(buf[i]);
-                        socketsMutex->unlock(); // Let other things happen on the sockets
-                        usleep(26667);          // Throttle to 300bps
-                        socketsMutex->lock();
+                        // Handle input on the client socket, waiting while the CPU catches up
+                        while (!input->keypress(buf[i]) && !stopping) {
+                            socketsMutex->unlock(); // Let other things happen on the sockets
+                            usleep(1000);
+                            socketsMutex->lock();
+                        }
                     }
                 }
             }